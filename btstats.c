@@ -2,6 +2,7 @@
 #include <glib/gprintf.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #include <getopt.h>
 
 #include <blktrace_api.h>
@@ -9,35 +10,70 @@
 
 #include <trace.h>
 #include <plugins.h>
+#include <emit.h>
+#include <stack.h>
 
 #include <utils.h>
+#include <serialize.h>
+
+#define CKPT_MAGIC 0x42545343 /* BTSC */
+#define CKPT_VERSION 1
+
+#define SUMMARY_MAGIC 0x42545353 /* BTSS */
+#define SUMMARY_VERSION 1
+
+#define CACHE_MAGIC 0x42545352 /* BTSR */
+#define CACHE_VERSION 1
 
 struct time_range {
 	__u64 start;
 	__u64 end;
 
 	struct plugin_set *ps; /* used in analysis */
+	__u64 wstart; /* current window (interval mode) */
+	gboolean wevents; /* events in the current window */
 };
 
 struct args {
 	GHashTable *devs_ranges;
 	gboolean total;
 	char *d2c_det;
+	char *lifecycle;
+	char *heat;
+	char *cpu_matrix;
+	__u32 heat_bands;
+	__u64 heat_res;
 	unsigned trc_rdr;
 	char *i2c_oio;
 	char *i2c_oio_hist;
+	char *ckpt;
+	char *summary;
+	char *cache;
+	__u64 max_age;
+	__u32 max_inflight;
+	int i2c_oio_mode;
+	__u64 i2c_oio_res;
+	gboolean binary;
+	gboolean stack;
+	__u64 interval;
+	int output;
 };
 
 struct analyze_args {
 	struct plugin_set *ps;
 	struct plug_args *pa;
 	trace_reader_t reader;
+	unsigned rdr;
+	char *ckpt;
+	char *cache;
+	__u64 interval;
 };
 
 void usage_exit()
 {
 	error_exit(
-		"Usage: btstats [-h] [-f <file>] [-r <reader>] [-t] [-d <file>] [-i <file>] [<trace> .. <trace>]\n\n"
+		"Usage: btstats [-h] [-f <file>] [-r <reader>] [-t] [-d <file>] [-i <file>] [-c <file>] [-S <file>] [-C <dir>] [-a <sec>] [-n <reqs>] [-I <sec>] [-b] [-L <file>] [-H <file>] [-B <bands>] [-R <sec>] [-M <file>] [-k] [-w <sec>] [-o <fmt>] [<trace> .. <trace>]\n"
+		"       btstats merge [-S <file>] [-o <fmt>] <summary> .. <summary>\n\n"
 		"Options:\n"
 		"\t-h: Show this help message and exit\n"
 		"\t-f: File which list the traces and phases to analyze.\n"
@@ -45,11 +81,60 @@ void usage_exit()
 		"\t-d: File sufix where all the details of D2C will be stored.\n"
 		"\t\t<timestamp> <Sector #> <Req. Size (blks)> <D2C time (sec)>\n"
 		"\t-i: File sufix where all the changes in OIO for I2C are logged.\n"
+		"\t-I: Resolution of the OIO changes logged with -i. With 0, only\n"
+		"\t    the last change of each timestamp is logged if the OIO\n"
+		"\t    changed. Otherwise, one line per bucket of <sec> seconds:\n"
+		"\t\t<bucket start> <min. OIO> <avg. OIO> <max. OIO>\n"
+		"\t-b: Write the files of -d and -i in binary.\n"
+		"\t-L: File sufix where a row per request with its Q, G, I, D and\n"
+		"\t    C times is stored, in a columnar binary format.\n"
+		"\t-H: File sufix where the requests per LBA band are logged, a line\n"
+		"\t    per bucket of -R seconds (1 by default) with requests:\n"
+		"\t\t<bucket start> <band size (blks)> <reqs band 0> .. <reqs band N>\n"
+		"\t-R: Resolution of the buckets of -H in seconds.\n"
+		"\t-B: Number of LBA bands (4096 by default).\n"
+		"\t-M: File sufix where the matrix of bios queued in a cpu (rows)\n"
+		"\t    and completed in a cpu (columns) is written:\n"
+		"\t\t<Q cpu> <bios C in cpu 0> .. <bios C in cpu N>\n"
+		"\t-k: Read the traces of all the devices as a single stream and\n"
+		"\t    follow the requests through the remaps (A) of a stack of\n"
+		"\t    devices (dm, md, partitions) to print the latency added by\n"
+		"\t    each layer, from the first start to the last end of\n"
+		"\t    the ranges.\n"
 		"\t-s: File sufix where the histogram of OIO for I2C is printed.\n"
 		"\t-r: Trace reader to be used\n"
 		"\t\t0: default\n"
 		"\t\t1: reader for driver ata_piix\n"
-		"\t<trace>: String of device/range to analyze. Exclusive with -f.\n");
+		"\t-c: Checkpoint file to resume from (if it exists) and to save the\n"
+		"\t    state to. Only new events are processed and the stats since\n"
+		"\t    the checkpoint are printed too. Single trace and range only,\n"
+		"\t    without -d, -i, -s, -L, -H or -M.\n"
+		"\t-S: File where the summary of the total stats is saved.\n"
+		"\t-C: Directory to cache the stats of each range. Repeated ranges\n"
+		"\t    are not read again and longer ones continue from the cache.\n"
+		"\t-a: Seconds after which a request still waiting for its\n"
+		"\t    completion is dropped and counted as unmatched (Q2C, I2C).\n"
+		"\t-n: Max. number of requests waiting for their completion. The\n"
+		"\t    oldest are dropped and counted as unmatched (Q2C, I2C).\n"
+		"\t-w: Print a row per window of <sec> seconds of each range instead\n"
+		"\t    of the stats of the whole range.\n"
+		"\t-o: Format of the stats: text (default), json (a line per\n"
+		"\t    range) or csv (a row per range, after a header).\n"
+		"\t<trace>: String of device/range to analyze. Exclusive with -f.\n"
+		"\tmerge: Print the total stats of the summaries given (saved with -S).\n");
+}
+
+int parse_output(const char *fmt)
+{
+	if (!strcmp(fmt, "text"))
+		return OUT_TEXT;
+	if (!strcmp(fmt, "json"))
+		return OUT_JSON;
+	if (!strcmp(fmt, "csv"))
+		return OUT_CSV;
+
+	usage_exit();
+	return OUT_TEXT;
 }
 
 void parse_file(char *filename, struct args *a)
@@ -161,6 +246,7 @@ void parse_dev_str(char **devs, struct args *a)
 void handle_args(int argc, char **argv, struct args *a)
 {
 	int c, r;
+	double age, res, win;
 	char *file = NULL;
 
 	memset(a, 0, sizeof(struct args));
@@ -175,10 +261,25 @@ void handle_args(int argc, char **argv, struct args *a)
 			{ "trace-read", required_argument, 0, 'r' },
 			{ "i2c-oio", required_argument, 0, 'i' },
 			{ "i2c-oio-hist", required_argument, 0, 's' },
+			{ "checkpoint", required_argument, 0, 'c' },
+			{ "summary", required_argument, 0, 'S' },
+			{ "cache", required_argument, 0, 'C' },
+			{ "max-age", required_argument, 0, 'a' },
+			{ "max-inflight", required_argument, 0, 'n' },
+			{ "i2c-oio-res", required_argument, 0, 'I' },
+			{ "binary", no_argument, 0, 'b' },
+			{ "interval", required_argument, 0, 'w' },
+			{ "output", required_argument, 0, 'o' },
+			{ "lifecycle", required_argument, 0, 'L' },
+			{ "heat", required_argument, 0, 'H' },
+			{ "heat-bands", required_argument, 0, 'B' },
+			{ "heat-res", required_argument, 0, 'R' },
+			{ "cpu-matrix", required_argument, 0, 'M' },
+			{ "stack", no_argument, 0, 'k' },
 			{ 0, 0, 0, 0 }
 		};
 
-		c = getopt_long(argc, argv, "f:thd:r:i:s:", long_options,
+		c = getopt_long(argc, argv, "f:thd:r:i:s:c:S:C:a:n:I:bw:o:L:H:B:R:M:k", long_options,
 				&option_index);
 
 		if (c == -1)
@@ -205,6 +306,69 @@ void handle_args(int argc, char **argv, struct args *a)
 		case 's':
 			a->i2c_oio_hist = optarg;
 			break;
+		case 'c':
+			a->ckpt = optarg;
+			break;
+		case 'S':
+			a->summary = optarg;
+			break;
+		case 'C':
+			a->cache = optarg;
+			break;
+		case 'a':
+			r = sscanf(optarg, "%lf", &age);
+			if (r != 1 || age <= 0)
+				usage_exit();
+			a->max_age = DOUBLE_TO_NANO_ULL(age);
+			break;
+		case 'n':
+			r = sscanf(optarg, "%u", &a->max_inflight);
+			if (r != 1 || !a->max_inflight)
+				usage_exit();
+			break;
+		case 'I':
+			r = sscanf(optarg, "%lf", &res);
+			if (r != 1 || res < 0)
+				usage_exit();
+			a->i2c_oio_res = DOUBLE_TO_NANO_ULL(res);
+			a->i2c_oio_mode = a->i2c_oio_res ? OIO_BUCKETS :
+							   OIO_CHANGES;
+			break;
+		case 'b':
+			a->binary = TRUE;
+			break;
+		case 'M':
+			a->cpu_matrix = optarg;
+			break;
+		case 'k':
+			a->stack = TRUE;
+			break;
+		case 'w':
+			r = sscanf(optarg, "%lf", &win);
+			if (r != 1 || DOUBLE_TO_NANO_ULL(win) == 0)
+				usage_exit();
+			a->interval = DOUBLE_TO_NANO_ULL(win);
+			break;
+		case 'o':
+			a->output = parse_output(optarg);
+			break;
+		case 'L':
+			a->lifecycle = optarg;
+			break;
+		case 'H':
+			a->heat = optarg;
+			break;
+		case 'B':
+			r = sscanf(optarg, "%u", &a->heat_bands);
+			if (r != 1 || !a->heat_bands)
+				usage_exit();
+			break;
+		case 'R':
+			r = sscanf(optarg, "%lf", &res);
+			if (r != 1 || DOUBLE_TO_NANO_ULL(res) == 0)
+				usage_exit();
+			a->heat_res = DOUBLE_TO_NANO_ULL(res);
+			break;
 		default:
 			usage_exit();
 			break;
@@ -218,6 +382,38 @@ void handle_args(int argc, char **argv, struct args *a)
 		parse_file(file, a);
 	else
 		parse_dev_str(&argv[optind], a);
+
+	if (a->ckpt) {
+		GHashTableIter it;
+		GArray *ranges;
+
+		g_hash_table_iter_init(&it, a->devs_ranges);
+		g_hash_table_iter_next(&it, NULL, (gpointer *)&ranges);
+		if (g_hash_table_size(a->devs_ranges) != 1 || ranges->len != 1)
+			error_exit("Checkpoints need a single trace and range\n");
+		if (a->trc_rdr != 0)
+			error_exit("Checkpoints need the default reader\n");
+
+		/* a resumed run would truncate what the earlier ones wrote */
+		if (a->d2c_det || a->i2c_oio || a->i2c_oio_hist ||
+		    a->lifecycle || a->heat || a->cpu_matrix)
+			error_exit("Checkpoints cannot be used with -d, -i, -s, -L, -H or -M\n");
+	}
+
+	/* windows reuse a single plugin set per range */
+	if (a->interval && (a->ckpt || a->cache || a->d2c_det || a->i2c_oio ||
+			    a->i2c_oio_hist || a->lifecycle || a->heat ||
+			    a->cpu_matrix))
+		error_exit("Intervals cannot be used with -c, -C, -d, -i, -s, -L, -H or -M\n");
+	if (a->interval && a->output != OUT_TEXT)
+		error_exit("Intervals are only printed as text\n");
+	if (a->stack && a->output != OUT_TEXT)
+		error_exit("The stack is only printed as text\n");
+
+	/* detail files are only written while reading the trace */
+	if (a->cache && (a->ckpt || a->d2c_det || a->i2c_oio || a->i2c_oio_hist ||
+			 a->lifecycle || a->heat || a->cpu_matrix))
+		error_exit("The cache cannot be used with -c, -d, -i, -s, -L, -H or -M\n");
 }
 
 void range_finish(struct time_range *range, struct plugin_set *gps,
@@ -226,10 +422,6 @@ void range_finish(struct time_range *range, struct plugin_set *gps,
 	char head[MAX_HEAD];
 	char end_range[MAX_HEAD / 2];
 
-	/* adding the current plugin set to the global ps */
-	if (gps)
-		plugin_set_add(gps, ps);
-
 	if (range->end == G_MAXUINT64)
 		sprintf(end_range, "%s", "inf");
 	else
@@ -239,17 +431,178 @@ void range_finish(struct time_range *range, struct plugin_set *gps,
 		end_range);
 
 	plugin_set_print(ps, head);
+
+	/* adding the current plugin set to the global ps (after printing
+	 * since that accounts the periods still ongoing) */
+	if (gps)
+		plugin_set_add(gps, ps);
+
 	plugin_set_destroy(ps);
 }
 
+char *cache_trace_dir(const char *cache, const char *dev, unsigned rdr,
+		      const struct plug_args *pa)
+{
+	char conf[128];
+	char *dir;
+	GChecksum *sum = g_checksum_new(G_CHECKSUM_SHA256);
+
+	/* identity of the trace files, reader and plugins */
+	trace_identity(dev, sum);
+	sprintf(conf,
+		"reader=%u;plugins=%u;max_age=%llu;max_inflight=%u;bands=%u",
+		rdr, PLUGIN_STATE_VERSION, pa->max_age, pa->max_inflight,
+		pa->heat_bands);
+	g_checksum_update(sum, (guchar *)conf, strlen(conf));
+
+	dir = g_build_filename(cache, g_checksum_get_string(sum), NULL);
+	g_checksum_free(sum);
+
+	return dir;
+}
+
+/* entries are <cache dir>/<trace id>/<start>/<end> */
+char *cache_entry(const char *trace_dir, __u64 start, __u64 end)
+{
+	char s[32], e[32];
+
+	sprintf(s, "%llu", start);
+	sprintf(e, "%llu", end);
+
+	return g_build_filename(trace_dir, s, e, NULL);
+}
+
+void cache_store(const char *trace_dir, const struct time_range *r,
+		 const struct trace *dt, const struct blk_io_trace *pending)
+{
+	char *entry = cache_entry(trace_dir, r->start, r->end);
+	char *dir = g_path_get_dirname(entry);
+	char *tmp = g_strdup_printf("%s.tmp", entry);
+	__u32 magic = CACHE_MAGIC, version = CACHE_VERSION;
+	__u8 has_pending = pending != NULL;
+	FILE *f;
+
+	if (g_mkdir_with_parents(dir, 0755))
+		perror_exit("Creating cache dir");
+
+	f = fopen(tmp, "w");
+	if (!f)
+		perror_exit("Opening cache entry");
+
+	/* the stats first, so hits do not need to open the trace */
+	SER_PUT(f, magic);
+	SER_PUT(f, version);
+	plugin_set_save(r->ps, f);
+	SER_PUT(f, has_pending);
+	if (has_pending)
+		ser_write(f, pending, sizeof(struct blk_io_trace));
+	trace_save(dt, f);
+
+	if (fclose(f))
+		perror_exit("Writing cache entry");
+	if (rename(tmp, entry))
+		perror_exit("Replacing cache entry");
+
+	g_free(tmp);
+	g_free(dir);
+	g_free(entry);
+}
+
+FILE *cache_open(const char *trace_dir, const struct time_range *r, __u64 end)
+{
+	__u32 magic, version;
+	char *entry = cache_entry(trace_dir, r->start, end);
+	FILE *f = fopen(entry, "r");
+
+	g_free(entry);
+	if (!f)
+		return NULL;
+
+	SER_GET(f, magic);
+	SER_GET(f, version);
+	if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+		fclose(f);
+		return NULL;
+	}
+
+	return f;
+}
+
+/* largest end cached for the start of @r before its end */
+gboolean cache_prefix(const char *trace_dir, const struct time_range *r,
+		      __u64 *end)
+{
+	char s[32];
+	char *dir, *e;
+	const char *name;
+	gboolean found = FALSE;
+	__u64 cur;
+	GDir *d;
+
+	sprintf(s, "%llu", r->start);
+	dir = g_build_filename(trace_dir, s, NULL);
+	d = g_dir_open(dir, 0, NULL);
+	g_free(dir);
+	if (!d)
+		return FALSE;
+
+	while ((name = g_dir_read_name(d))) {
+		cur = g_ascii_strtoull(name, &e, 10);
+		if (*e == '\0' && cur < r->end && (!found || cur > *end)) {
+			*end = cur;
+			found = TRUE;
+		}
+	}
+	g_dir_close(d);
+
+	return found;
+}
+
 void analyze_device(char *dev, GArray *ranges, struct plugin_set *ps,
-		    struct plug_args *pa, trace_reader_t read_next)
+		    struct plug_args *pa, trace_reader_t read_next,
+		    const char *cache, unsigned rdr)
 {
 	unsigned i;
 	struct blk_io_trace t;
-	struct trace *dt;
+	struct trace *dt = NULL;
+	char *trace_dir = NULL;
+	gboolean more = FALSE;
+	__u64 end;
+	FILE *f;
 
-	/* init all plugin sets */
+	if (cache) {
+		trace_dir = cache_trace_dir(cache, dev, rdr, pa);
+
+		/* ranges already computed, whose sets take the cpus from
+		 * the state loaded */
+		pa->ncpus = 0;
+		i = 0;
+		while (i < ranges->len) {
+			struct time_range *r =
+				&g_array_index(ranges, struct time_range, i);
+
+			f = cache_open(trace_dir, r, r->end);
+			if (f) {
+				pa->end_range = r->end;
+				r->ps = plugin_set_create(pa);
+				plugin_set_load(r->ps, f);
+				fclose(f);
+				range_finish(r, ps, r->ps, dev);
+				g_array_remove_index_fast(ranges, i);
+			} else {
+				i++;
+			}
+		}
+	}
+
+	/* the trace is only opened if there are ranges left to read */
+	if (!ranges->len) {
+		g_free(trace_dir);
+		return;
+	}
+
+	/* init the plugin sets left */
+	pa->ncpus = trace_ncpus(dev);
 	for (i = 0; i < ranges->len; ++i) {
 		struct time_range *r =
 			&g_array_index(ranges, struct time_range, i);
@@ -257,15 +610,42 @@ void analyze_device(char *dev, GArray *ranges, struct plugin_set *ps,
 		r->ps = plugin_set_create(pa);
 	}
 
+	if (cache) {
+		/* a single range left can continue from a shorter one
+		 * with the same start (needs a reader without state) */
+		if (ranges->len == 1 && rdr == 0) {
+			struct time_range *r =
+				&g_array_index(ranges, struct time_range, 0);
+
+			if (cache_prefix(trace_dir, r, &end) &&
+			    (f = cache_open(trace_dir, r, end))) {
+				__u8 p;
+
+				plugin_set_load(r->ps, f);
+				SER_GET(f, p);
+				if (p)
+					ser_read(f, &t, sizeof(t));
+				more = p;
+				dt = trace_restore(f);
+				fclose(f);
+			}
+		}
+	}
+
 	/* read and collect stats */
-	dt = trace_create(dev);
-	while (read_next(dt, &t) && ranges->len > 0) {
+	if (!dt)
+		dt = trace_create(dev);
+	if (!more)
+		more = read_next(dt, &t);
+	while (more && ranges->len > 0) {
 		i = 0;
 		while (i < ranges->len) {
 			struct time_range *r =
 				&g_array_index(ranges, struct time_range, i);
 
 			if (t.time > r->end) {
+				if (trace_dir)
+					cache_store(trace_dir, r, dt, &t);
 				range_finish(r, ps, r->ps, dev);
 				g_array_remove_index_fast(ranges, i);
 			} else {
@@ -275,15 +655,291 @@ void analyze_device(char *dev, GArray *ranges, struct plugin_set *ps,
 				i++;
 			}
 		}
+
+		more = read_next(dt, &t);
 	}
-	trace_destroy(dt);
 
 	/* finish the ps which range is beyond the end */
 	for (i = 0; i < ranges->len; ++i) {
 		struct time_range *r =
 			&g_array_index(ranges, struct time_range, i);
+		if (trace_dir)
+			cache_store(trace_dir, r, dt, NULL);
 		range_finish(r, ps, r->ps, dev);
 	}
+	trace_destroy(dt);
+	g_free(trace_dir);
+}
+
+void save_checkpoint(const char *ckpt, const char *dev,
+		     const struct time_range *r, const struct trace *dt,
+		     const struct blk_io_trace *pending, __u64 last)
+{
+	char tmp[FILENAME_MAX];
+	__u32 magic = CKPT_MAGIC, version = CKPT_VERSION;
+	__u32 len = strlen(dev);
+	__u8 has_pending = pending != NULL;
+	FILE *f;
+
+	/* write a new file and replace the old one only when complete */
+	snprintf(tmp, sizeof(tmp), "%s.tmp", ckpt);
+	f = fopen(tmp, "w");
+	if (!f)
+		perror_exit("Opening checkpoint");
+
+	SER_PUT(f, magic);
+	SER_PUT(f, version);
+	SER_PUT(f, len);
+	ser_write(f, dev, len);
+	SER_PUT(f, r->start);
+	SER_PUT(f, r->end);
+	SER_PUT(f, last);
+	SER_PUT(f, has_pending);
+	if (has_pending)
+		ser_write(f, pending, sizeof(struct blk_io_trace));
+	trace_save(dt, f);
+	plugin_set_save(r->ps, f);
+
+	if (fclose(f))
+		perror_exit("Writing checkpoint");
+	if (rename(tmp, ckpt))
+		perror_exit("Replacing checkpoint");
+}
+
+struct trace *load_checkpoint(FILE *f, const char *dev,
+			      const struct time_range *r,
+			      struct blk_io_trace *pending,
+			      gboolean *has_pending, __u64 *last, long *ps_off)
+{
+	__u32 magic, version, len;
+	__u64 start, end;
+	__u8 p;
+	char saved_dev[FILENAME_MAX];
+	struct trace *dt;
+
+	SER_GET(f, magic);
+	SER_GET(f, version);
+	if (magic != CKPT_MAGIC || version != CKPT_VERSION)
+		error_exit("Not a checkpoint or wrong version\n");
+
+	SER_GET(f, len);
+	if (len >= FILENAME_MAX)
+		error_exit("Corrupted checkpoint\n");
+	ser_read(f, saved_dev, len);
+	saved_dev[len] = '\0';
+	SER_GET(f, start);
+	SER_GET(f, end);
+	if (strcmp(saved_dev, dev) || start != r->start || end != r->end)
+		error_exit("Checkpoint taken for another trace or range\n");
+
+	SER_GET(f, *last);
+	SER_GET(f, p);
+	*has_pending = p;
+	if (p)
+		ser_read(f, pending, sizeof(struct blk_io_trace));
+
+	dt = trace_restore(f);
+	*ps_off = ftell(f);
+
+	return dt;
+}
+
+void checkpoint_device(char *dev, struct time_range *r, struct plugin_set *gps,
+		       struct plug_args *pa, trace_reader_t read_next,
+		       char *ckpt)
+{
+	char head[MAX_HEAD];
+	struct blk_io_trace t;
+	struct trace *dt;
+	struct plugin_set *inc = NULL;
+	gboolean more = FALSE;
+	__u64 last = r->start, prev = 0;
+	long ps_off;
+	FILE *f;
+
+	pa->end_range = r->end;
+	pa->ncpus = trace_ncpus(dev);
+	r->ps = plugin_set_create(pa);
+
+	f = fopen(ckpt, "r");
+	if (f) {
+		dt = load_checkpoint(f, dev, r, &t, &more, &last, &ps_off);
+		plugin_set_load(r->ps, f);
+
+		/* the stats of the new events only: same state with the
+		 * accumulated stats cleared */
+		inc = plugin_set_create(pa);
+		fseek(f, ps_off, SEEK_SET);
+		plugin_set_load(inc, f);
+		plugin_set_reset(inc);
+
+		fclose(f);
+		prev = last;
+	} else if (errno == ENOENT) {
+		dt = trace_create(dev);
+	} else {
+		perror_exit("Opening checkpoint");
+	}
+
+	if (!more)
+		more = read_next(dt, &t);
+
+	/* the per-cpu files can be flushed at different times, so the
+	 * events after the end of any of them are left for the next run */
+	while (more && t.time <= r->end && t.time <= trace_horizon(dt)) {
+		if (r->start <= t.time) {
+			plugin_set_add_trace(r->ps, &t);
+			if (inc)
+				plugin_set_add_trace(inc, &t);
+		}
+		last = t.time;
+		more = read_next(dt, &t);
+	}
+
+	/* saved before printing since that accounts the ongoing periods */
+	save_checkpoint(ckpt, dev, r, dt, more ? &t : NULL, last);
+	trace_destroy(dt);
+
+	range_finish(r, gps, r->ps, dev);
+
+	if (inc) {
+		sprintf(head, "%s[+%.4f:%.4f]", dev, NANO_ULL_TO_DOUBLE(prev),
+			NANO_ULL_TO_DOUBLE(last));
+		plugin_set_print(inc, head);
+		plugin_set_destroy(inc);
+	}
+}
+
+void checkpoint_device_hash(gpointer dev_arg, gpointer ranges_arg, gpointer ar)
+{
+	char *dev = dev_arg;
+	GArray *ranges = ranges_arg;
+	struct analyze_args *aa = ar;
+
+	checkpoint_device(dev, &g_array_index(ranges, struct time_range, 0),
+			  aa->ps, aa->pa, aa->reader, aa->ckpt);
+
+	free(dev);
+	g_array_free(ranges, TRUE);
+}
+
+/* print the rows of the windows of @r ended before @time */
+void window_flush(struct time_range *r, struct plugin_set *gps,
+		  const char *head, __u64 interval, __u64 time)
+{
+	while (time >= r->wstart + interval) {
+		plugin_set_print_row(r->ps, head, r->wstart,
+				     r->wstart + interval);
+		if (gps)
+			plugin_set_add(gps, r->ps);
+		plugin_set_reset(r->ps);
+
+		r->wstart += interval;
+		r->wevents = FALSE;
+	}
+}
+
+void window_finish(struct time_range *r, struct plugin_set *gps,
+		   const char *head, __u64 last)
+{
+	/* the last window ends with the last event (which can be at its
+	 * start) */
+	if (r->wevents) {
+		plugin_set_print_row(r->ps, head, r->wstart, last);
+		if (gps)
+			plugin_set_add(gps, r->ps);
+	}
+
+	plugin_set_destroy(r->ps);
+}
+
+void window_device(char *dev, GArray *ranges, struct plugin_set *gps,
+		   struct plug_args *pa, trace_reader_t read_next,
+		   __u64 interval)
+{
+	unsigned i;
+	struct blk_io_trace t;
+	struct trace *dt = trace_create(dev);
+	struct plug_args wpa = *pa;
+	char **heads = g_new(char *, ranges->len);
+	__u64 *lasts = g_new0(__u64, ranges->len);
+	unsigned done = 0;
+	gboolean more;
+
+	/* one set per range, without detail files, reset at each window */
+	wpa.d2c_det_f = wpa.i2c_oio_f = wpa.i2c_oio_hist_f = NULL;
+	wpa.lifecycle_f = wpa.heat_f = wpa.cpus_f = NULL;
+	wpa.ncpus = trace_ncpus(dev);
+	for (i = 0; i < ranges->len; ++i) {
+		struct time_range *r =
+			&g_array_index(ranges, struct time_range, i);
+
+		wpa.end_range = r->end;
+		r->ps = plugin_set_create(&wpa);
+		r->wstart = r->start;
+		r->wevents = FALSE;
+
+		if (r->end == G_MAXUINT64)
+			heads[i] = g_strdup_printf("%s[%.4f:inf]", dev,
+						   NANO_ULL_TO_DOUBLE(r->start));
+		else
+			heads[i] = g_strdup_printf("%s[%.4f:%.4f]", dev,
+						   NANO_ULL_TO_DOUBLE(r->start),
+						   NANO_ULL_TO_DOUBLE(r->end));
+		plugin_set_print_row_head(r->ps, heads[i]);
+	}
+
+	/* until every range has ended */
+	more = read_next(dt, &t);
+	while (more && done < ranges->len) {
+		for (i = 0; i < ranges->len; ++i) {
+			struct time_range *r =
+				&g_array_index(ranges, struct time_range, i);
+
+			if (r->start > t.time || !r->ps)
+				continue;
+
+			if (t.time > r->end) {
+				window_flush(r, gps, heads[i], interval, r->end);
+				window_finish(r, gps, heads[i], r->end);
+				r->ps = NULL;
+				done++;
+				continue;
+			}
+
+			window_flush(r, gps, heads[i], interval, t.time);
+			plugin_set_add_trace(r->ps, &t);
+			r->wevents = TRUE;
+			lasts[i] = t.time;
+		}
+
+		more = read_next(dt, &t);
+	}
+
+	for (i = 0; i < ranges->len; ++i) {
+		struct time_range *r =
+			&g_array_index(ranges, struct time_range, i);
+
+		if (r->ps)
+			window_finish(r, gps, heads[i], lasts[i]);
+		g_free(heads[i]);
+	}
+
+	g_free(heads);
+	g_free(lasts);
+	trace_destroy(dt);
+}
+
+void window_device_hash(gpointer dev_arg, gpointer ranges_arg, gpointer ar)
+{
+	char *dev = dev_arg;
+	GArray *ranges = ranges_arg;
+	struct analyze_args *aa = ar;
+
+	window_device(dev, ranges, aa->ps, aa->pa, aa->reader, aa->interval);
+
+	free(dev);
+	g_array_free(ranges, TRUE);
 }
 
 void analyze_device_hash(gpointer dev_arg, gpointer ranges_arg, gpointer ar)
@@ -293,13 +949,123 @@ void analyze_device_hash(gpointer dev_arg, gpointer ranges_arg, gpointer ar)
 	struct plugin_set *global_plugin = ((struct analyze_args *)ar)->ps;
 	struct plug_args *pa = ((struct analyze_args *)ar)->pa;
 	trace_reader_t rdr = ((struct analyze_args *)ar)->reader;
+	unsigned rdr_id = ((struct analyze_args *)ar)->rdr;
+	char *cache = ((struct analyze_args *)ar)->cache;
 
-	analyze_device(dev, ranges, global_plugin, pa, rdr);
+	analyze_device(dev, ranges, global_plugin, pa, rdr, cache, rdr_id);
 
 	free(dev);
 	g_array_free(ranges, TRUE);
 }
 
+/* the latency added by each layer in [start, end], reading all the
+ * devices at once */
+void stack_devices(char **devs, unsigned n, __u64 start, __u64 end,
+		   const struct plug_args *pa, trace_reader_t read_next)
+{
+	struct blk_io_trace t;
+	struct trace *dt = trace_create_stack(devs, n);
+	struct stack *st = stack_create(pa);
+
+	while (read_next(dt, &t) && t.time <= end) {
+		if (t.time < start)
+			continue;
+
+		/* the layers are named after the trace of their device */
+		stack_name(st, t.device, trace_dev());
+		stack_add_trace(st, &t);
+	}
+	trace_destroy(dt);
+
+	stack_print(st);
+	stack_destroy(st);
+}
+
+void save_summary(const char *filename, const struct plugin_set *ps)
+{
+	__u32 magic = SUMMARY_MAGIC, version = SUMMARY_VERSION;
+	FILE *f = fopen(filename, "w");
+
+	if (!f)
+		perror_exit("Opening summary");
+
+	SER_PUT(f, magic);
+	SER_PUT(f, version);
+	plugin_set_save(ps, f);
+
+	if (fclose(f))
+		perror_exit("Writing summary");
+}
+
+void load_summary(const char *filename, struct plugin_set *ps)
+{
+	__u32 magic, version;
+	char buf[1 << 16];
+	FILE *f = fopen(filename, "r");
+
+	if (!f)
+		perror_exit("Opening summary");
+	setvbuf(f, buf, _IOFBF, sizeof(buf));
+
+	SER_GET(f, magic);
+	SER_GET(f, version);
+	if (magic == GUINT32_SWAP_LE_BE(SUMMARY_MAGIC))
+		error_exit("%s: summary saved with another byte order\n",
+			   filename);
+	if (magic != SUMMARY_MAGIC || version != SUMMARY_VERSION)
+		error_exit("%s: not a summary or wrong version\n", filename);
+	plugin_set_load(ps, f);
+
+	fclose(f);
+}
+
+int merge_summaries(int argc, char **argv)
+{
+	int c, i;
+	char *out = NULL;
+	int output = OUT_TEXT;
+	struct plugin_set *total, *ps;
+
+	while ((c = getopt(argc, argv, "hS:o:")) != -1) {
+		switch (c) {
+		case 'S':
+			out = optarg;
+			break;
+		case 'o':
+			output = parse_output(optarg);
+			break;
+		default:
+			usage_exit();
+			break;
+		}
+	}
+
+	if (argc == optind)
+		usage_exit();
+
+	init_plugs_ops();
+	set_plugs_output(output);
+
+	total = plugin_set_create(NULL);
+	for (i = optind; i < argc; ++i) {
+		ps = plugin_set_create(NULL);
+		load_summary(argv[i], ps);
+		plugin_set_add(total, ps);
+		plugin_set_destroy(ps);
+	}
+
+	/* merged summaries can be merged again */
+	if (out)
+		save_summary(out, total);
+
+	plugin_set_print(total, "All");
+	plugin_set_destroy(total);
+
+	destroy_plugs_ops();
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	struct args a;
@@ -307,29 +1073,92 @@ int main(int argc, char **argv)
 
 	struct analyze_args ar;
 	struct plugin_set *global_plugin = NULL;
+	char **stack_devs = NULL;
+	guint n_stack = 0;
+	__u64 stack_start = G_MAXUINT64, stack_end = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "merge"))
+		return merge_summaries(argc - 1, argv + 1);
 
 	handle_args(argc, argv, &a);
 
 	init_plugs_ops();
+	set_plugs_output(a.output);
 
-	if (a.total)
+	if (a.total || a.summary)
 		global_plugin = plugin_set_create(NULL);
 
 	/* populate plugin arguments */
 	pa.d2c_det_f = a.d2c_det;
 	pa.i2c_oio_f = a.i2c_oio;
 	pa.i2c_oio_hist_f = a.i2c_oio_hist;
+	pa.lifecycle_f = a.lifecycle;
+	pa.heat_f = a.heat;
+	pa.cpus_f = a.cpu_matrix;
+	pa.ncpus = 0;
+	pa.heat_bands = a.heat_bands;
+	pa.heat_res = a.heat_res ? a.heat_res : DOUBLE_TO_NANO_ULL(1.0);
+	pa.max_age = a.max_age;
+	pa.max_inflight = a.max_inflight;
+	pa.i2c_oio_mode = a.i2c_oio_mode;
+	pa.i2c_oio_res = a.i2c_oio_res;
+	pa.binary = a.binary;
+
+	/* the names are freed with the analysis of each device, so they are
+	 * copied for the stack */
+	if (a.stack) {
+		GHashTableIter it;
+		gpointer dev, ranges;
+
+		/* with the span of all their ranges */
+		stack_devs = g_new(char *, g_hash_table_size(a.devs_ranges));
+		g_hash_table_iter_init(&it, a.devs_ranges);
+		while (g_hash_table_iter_next(&it, &dev, &ranges)) {
+			GArray *rs = ranges;
+			guint i;
+
+			stack_devs[n_stack++] = g_strdup(dev);
+			for (i = 0; i < rs->len; ++i) {
+				struct time_range *r = &g_array_index(
+					rs, struct time_range, i);
+
+				stack_start = MIN(stack_start, r->start);
+				stack_end = MAX(stack_end, r->end);
+			}
+		}
+	}
 
 	/* analyze each device with its ranges */
 	ar.ps = global_plugin;
 	ar.pa = &pa;
 	ar.reader = reader[a.trc_rdr];
-	g_hash_table_foreach(a.devs_ranges, analyze_device_hash, &ar);
+	ar.rdr = a.trc_rdr;
+	ar.ckpt = a.ckpt;
+	ar.cache = a.cache;
+	ar.interval = a.interval;
+	if (a.ckpt)
+		g_hash_table_foreach(a.devs_ranges, checkpoint_device_hash,
+				     &ar);
+	else if (a.interval)
+		g_hash_table_foreach(a.devs_ranges, window_device_hash, &ar);
+	else
+		g_hash_table_foreach(a.devs_ranges, analyze_device_hash, &ar);
+
+	if (a.stack) {
+		stack_devices(stack_devs, n_stack, stack_start, stack_end, &pa,
+			      reader[a.trc_rdr]);
+		while (n_stack--)
+			g_free(stack_devs[n_stack]);
+		g_free(stack_devs);
+	}
 
-	if (a.total) {
+	if (a.summary)
+		save_summary(a.summary, global_plugin);
+
+	if (a.total)
 		plugin_set_print(global_plugin, "All");
+	if (global_plugin)
 		plugin_set_destroy(global_plugin);
-	}
 
 	destroy_plugs_ops();
 
@@ -0,0 +1,167 @@
+#ifndef _INFLIGHT_H_
+#define _INFLIGHT_H_
+
+#include <stdio.h>
+#include <glib.h>
+
+#include <blktrace_api.h>
+#include <plugins.h>
+#include <serialize.h>
+#include <utils.h>
+
+/*
+ * Requests waiting for their completion, kept in arrival (time) order
+ * so the ones that never complete (merged, split or lost with dropped
+ * events) can be evicted from the oldest once they are older than
+ * @max_age or there are more than @max_n. The plugin keeps its own
+ * index of the requests and is told about every eviction.
+ */
+
+struct inflight_req {
+	struct blk_io_trace t;
+	GList link;
+};
+
+struct inflight {
+	GQueue q;
+
+	/* limits (0 means no limit) */
+	__u64 max_age;
+	__u32 max_n;
+
+	/* requests evicted */
+	__u64 unmatched;
+};
+
+typedef void (*inflight_evict_t)(struct inflight_req *r,
+				 const struct blk_io_trace *now, void *data);
+
+static inline void inflight_init(struct inflight *in,
+				 const struct plug_args *pa)
+{
+	g_queue_init(&in->q);
+	in->max_age = pa ? pa->max_age : 0;
+	in->max_n = pa ? pa->max_inflight : 0;
+	in->unmatched = 0;
+}
+
+/* follow @t in @r, allocated by the plugin (which then frees the
+ * requests itself instead of inflight_destroy) */
+static inline void inflight_insert(struct inflight *in, struct inflight_req *r,
+				   const struct blk_io_trace *t)
+{
+	memcpy(&r->t, t, sizeof(struct blk_io_trace));
+	r->link.data = r;
+	g_queue_push_tail_link(&in->q, &r->link);
+}
+
+/* @size (at least sizeof(struct inflight_req)) lets the plugin keep its
+ * own fields after the request, which must be its first member */
+static inline struct inflight_req *__inflight_add(struct inflight *in,
+						  const struct blk_io_trace *t,
+						  size_t size)
+{
+	struct inflight_req *r = g_malloc0(size);
+
+	inflight_insert(in, r, t);
+	return r;
+}
+
+static inline struct inflight_req *inflight_add(struct inflight *in,
+						const struct blk_io_trace *t)
+{
+	return __inflight_add(in, t, sizeof(struct inflight_req));
+}
+
+/* @r is freed by the caller */
+static inline void inflight_del(struct inflight *in, struct inflight_req *r)
+{
+	g_queue_unlink(&in->q, &r->link);
+}
+
+static inline gboolean __inflight_expired(const struct inflight *in,
+					  const struct blk_io_trace *now)
+{
+	const struct inflight_req *old;
+
+	if (in->max_n && in->q.length > in->max_n)
+		return TRUE;
+
+	old = in->q.head ? in->q.head->data : NULL;
+	return in->max_age && old && now->time > old->t.time &&
+	       now->time - old->t.time > in->max_age;
+}
+
+/* evict the requests over the limits at time @now->time. @evict removes
+ * @r from the plugin index and frees it */
+static inline void inflight_expire(struct inflight *in,
+				   const struct blk_io_trace *now,
+				   inflight_evict_t evict, void *data)
+{
+	while (__inflight_expired(in, now)) {
+		struct inflight_req *r = in->q.head->data;
+
+		inflight_del(in, r);
+		in->unmatched++;
+		evict(r, now, data);
+	}
+}
+
+/* add to @done the requests of @tree, sorted by sector from the key
+ * @first (for BIT_START(t)), that are inside [BIT_START(t), BIT_END(t)]
+ * and so complete with @t. A zero-length bio, like a flush, may start
+ * at the end. The tree values start with their struct inflight_req. */
+static inline void inflight_covered(GTree *tree, gconstpointer first,
+				    const struct blk_io_trace *t,
+				    GPtrArray *done)
+{
+	__u64 end = BIT_END(t);
+	GTreeNode *n;
+
+	for (n = g_tree_lower_bound(tree, first); n; n = g_tree_node_next(n)) {
+		struct inflight_req *r = g_tree_node_value(n);
+		const struct blk_io_trace *qt = &r->t;
+
+		if (BIT_START(qt) > end)
+			break;
+		if (BIT_END(qt) <= end)
+			g_ptr_array_add(done, r);
+	}
+}
+
+static inline void inflight_destroy(struct inflight *in)
+{
+	while (in->q.head)
+		g_free(g_queue_pop_head_link(&in->q)->data);
+}
+
+/* the requests are saved in arrival order; @insert adds each loaded
+ * request to the plugin index */
+static inline void ser_put_inflight(FILE *f, const struct inflight *in)
+{
+	__u32 n = in->q.length;
+	GList *l;
+
+	SER_PUT(f, n);
+	for (l = in->q.head; l; l = l->next)
+		ser_write(f, l->data, sizeof(struct blk_io_trace));
+	SER_PUT(f, in->unmatched);
+}
+
+static inline void ser_get_inflight(FILE *f, struct inflight *in,
+				    void (*insert)(struct inflight_req *r,
+						   void *data),
+				    void *data)
+{
+	struct blk_io_trace t;
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		insert(inflight_add(in, &t), data);
+	}
+	SER_GET(f, in->unmatched);
+}
+
+#endif
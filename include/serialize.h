@@ -0,0 +1,59 @@
+#ifndef _SERIALIZE_H_
+#define _SERIALIZE_H_
+
+#include <stdio.h>
+#include <glib.h>
+
+#include <blktrace_api.h>
+#include <utils.h>
+
+/*
+ * Helpers to dump and restore the state of the analysis (plugins and
+ * trace reader) in a binary stream. The format is host dependent since
+ * it is only meant to be read back by btstats in the same machine.
+ */
+
+static inline void ser_write(FILE *f, const void *buf, size_t len)
+{
+	if (len && fwrite(buf, len, 1, f) != 1)
+		error_exit("Error writing state file\n");
+}
+
+static inline void ser_read(FILE *f, void *buf, size_t len)
+{
+	if (len && fread(buf, len, 1, f) != 1)
+		error_exit("Truncated or corrupted state file\n");
+}
+
+#define SER_PUT(f, v) ser_write(f, &(v), sizeof(v))
+#define SER_GET(f, v) ser_read(f, &(v), sizeof(v))
+
+static inline gboolean __ser_put_trace(gpointer __unused, gpointer t,
+				       gpointer f)
+{
+	ser_write(f, t, sizeof(struct blk_io_trace));
+	return FALSE;
+}
+
+/* trees of traces are always keyed by &t->sector */
+static inline void ser_put_trace_tree(FILE *f, GTree *tree)
+{
+	__u32 n = g_tree_nnodes(tree);
+
+	SER_PUT(f, n);
+	g_tree_foreach(tree, __ser_put_trace, f);
+}
+
+static inline void ser_get_trace_tree(FILE *f, GTree *tree)
+{
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		struct blk_io_trace *t = g_new(struct blk_io_trace, 1);
+		ser_read(f, t, sizeof(struct blk_io_trace));
+		g_tree_insert(tree, &t->sector, t);
+	}
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <string.h>
+#include <glib.h>
+
+/*
+ * Objects of a single size carved from large chunks and recycled through
+ * a free list, for the records allocated and freed once per request. The
+ * objects are zeroed when allocated and all freed with the slab.
+ */
+
+#define SLAB_CHUNK 4096
+
+struct slab {
+	size_t size;
+	GPtrArray *chunks;
+
+	/* free objects, linked through their first word */
+	void *free;
+};
+
+static inline void slab_init(struct slab *s, size_t size)
+{
+	s->size = MAX(size, sizeof(void *));
+	s->chunks = g_ptr_array_new();
+	s->free = NULL;
+}
+
+static inline void *slab_alloc(struct slab *s)
+{
+	void *p;
+	char *chunk;
+	unsigned i;
+
+	if (!s->free) {
+		chunk = g_malloc(s->size * SLAB_CHUNK);
+		g_ptr_array_add(s->chunks, chunk);
+		for (i = 0; i < SLAB_CHUNK; i++) {
+			*(void **)(chunk + i * s->size) = s->free;
+			s->free = chunk + i * s->size;
+		}
+	}
+
+	p = s->free;
+	s->free = *(void **)p;
+	memset(p, 0, s->size);
+
+	return p;
+}
+
+static inline void slab_free(struct slab *s, void *p)
+{
+	*(void **)p = s->free;
+	s->free = p;
+}
+
+static inline void slab_destroy(struct slab *s)
+{
+	unsigned i;
+
+	for (i = 0; i < s->chunks->len; i++)
+		g_free(g_ptr_array_index(s->chunks, i));
+	g_ptr_array_free(s->chunks, TRUE);
+}
+
+#endif
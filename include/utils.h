@@ -1,3 +1,6 @@
+#ifndef _UTILS_H_
+#define _UTILS_H_
+
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -52,6 +55,18 @@ inline static int comp_int64(gconstpointer a, gconstpointer b)
 		return x > y ? 1 : -1;
 }
 
+/* 64-bit finalizer of murmur3, to hash blocks and devices */
+inline static __u64 mix(__u64 h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
 inline static void get_filename(char *filename, char *suffix, char *param,
 				__u64 end_range)
 {
@@ -61,3 +76,5 @@ inline static void get_filename(char *filename, char *suffix, char *param,
 		sprintf(filename, "%s_%s_%.4f", suffix, param,
 			NANO_ULL_TO_DOUBLE(end_range));
 }
+
+#endif
@@ -6,6 +6,9 @@
 #include <blktrace.h>
 #include <plugins.h>
 #include <utils.h>
+#include <serialize.h>
+#include <lhist.h>
+#include <emit.h>
 
 #define NOT_NUM (~(0U))
 
@@ -17,6 +20,7 @@ struct c2d_data {
 	__u64 max;
 	__u64 total;
 	__u32 total_gaps;
+	struct lhist gaps;
 
 	__u32 outstanding;
 	__u64 last_C;
@@ -52,6 +56,7 @@ static void C(struct blk_io_trace *t, void *data)
 			c2d->total += c2d->prospect_time;
 			c2d->min = MIN(c2d->min, c2d->prospect_time);
 			c2d->max = MAX(c2d->max, c2d->prospect_time);
+			lhist_record(&c2d->gaps, c2d->prospect_time);
 			c2d->prospect_time = NOT_NUM;
 			c2d->total_gaps++;
 		}
@@ -67,22 +72,79 @@ void c2d_add(void *data1, const void *data2)
 	c2d1->total_gaps += c2d2->total_gaps;
 	c2d1->min = MIN(c2d1->min, c2d2->min);
 	c2d1->max = MAX(c2d1->max, c2d2->max);
+	lhist_add(&c2d1->gaps, &c2d2->gaps);
 }
 
 void c2d_print_results(const void *data)
 {
 	DECL_ASSIGN_C2D(c2d, data);
 
-	if (c2d->total)
+	if (c2d->total) {
 		printf("C2D Total: %f min: %f avg: %f max: %f (sec)\n",
 		       NANO_ULL_TO_DOUBLE(c2d->total),
 		       NANO_ULL_TO_DOUBLE(c2d->min),
 		       NANO_ULL_TO_DOUBLE(c2d->total) / c2d->total_gaps,
 		       NANO_ULL_TO_DOUBLE(c2d->max));
-	else
+		lhist_print(&c2d->gaps, "C2D", 1e9, "sec");
+	} else
 		printf("C2D Total: 0\n");
 }
 
+void c2d_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_C2D(c2d, data);
+
+	emit_double(e, "c2d_total_sec", NANO_ULL_TO_DOUBLE(c2d->total));
+	emit_u64(e, "c2d_gaps", c2d->total_gaps);
+	emit_double(e, "c2d_min_sec",
+		    c2d->total ? NANO_ULL_TO_DOUBLE(c2d->min) : 0);
+	emit_double(e, "c2d_avg_sec",
+		    c2d->total_gaps ? NANO_ULL_TO_DOUBLE(c2d->total) /
+					      c2d->total_gaps :
+				      0);
+	emit_double(e, "c2d_max_sec", NANO_ULL_TO_DOUBLE(c2d->max));
+	lhist_emit(&c2d->gaps, e, "c2d_sec", 1e9);
+}
+
+void c2d_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_C2D(c2d, data);
+
+	SER_PUT(f, c2d->min);
+	SER_PUT(f, c2d->max);
+	SER_PUT(f, c2d->total);
+	SER_PUT(f, c2d->total_gaps);
+	SER_PUT(f, c2d->outstanding);
+	SER_PUT(f, c2d->last_C);
+	SER_PUT(f, c2d->prospect_time);
+	lhist_save(&c2d->gaps, f);
+}
+
+void c2d_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_C2D(c2d, data);
+
+	SER_GET(f, c2d->min);
+	SER_GET(f, c2d->max);
+	SER_GET(f, c2d->total);
+	SER_GET(f, c2d->total_gaps);
+	SER_GET(f, c2d->outstanding);
+	SER_GET(f, c2d->last_C);
+	SER_GET(f, c2d->prospect_time);
+	lhist_load(&c2d->gaps, f);
+}
+
+void c2d_reset(void *data)
+{
+	DECL_ASSIGN_C2D(c2d, data);
+
+	c2d->min = NOT_NUM;
+	c2d->max = 0;
+	c2d->total = 0;
+	c2d->total_gaps = 0;
+	lhist_reset(&c2d->gaps);
+}
+
 void c2d_init(struct plugin *p, struct plugin_set *__un1,
 	      struct plug_args *__un2)
 {
@@ -90,12 +152,17 @@ void c2d_init(struct plugin *p, struct plugin_set *__un1,
 	c2d->min = NOT_NUM;
 	c2d->last_C = NOT_NUM;
 	c2d->prospect_time = NOT_NUM;
+	lhist_init(&c2d->gaps);
 }
 
 void c2d_ops_init(struct plugin_ops *po)
 {
 	po->add = c2d_add;
 	po->print_results = c2d_print_results;
+	po->emit = c2d_emit;
+	po->save = c2d_save;
+	po->load = c2d_load;
+	po->reset = c2d_reset;
 
 	/* association of event int and function */
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
@@ -105,5 +172,8 @@ void c2d_ops_init(struct plugin_ops *po)
 
 void c2d_destroy(struct plugin *p)
 {
+	DECL_ASSIGN_C2D(c2d, p->data);
+
+	lhist_destroy(&c2d->gaps);
 	g_free(p->data);
 }
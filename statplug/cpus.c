@@ -0,0 +1,389 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <slab.h>
+#include <lhist.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_CPUS(name, data) \
+	struct cpus_data *name = (struct cpus_data *)data
+
+/*
+ * Bios queued and requests completed per cpu, with the Q2C of the bios
+ * by the cpu that queued them, and the matrix of the cpu of the Q by the
+ * cpu of the C of each bio. The arrays have a slot per per-cpu file of the
+ * trace and grow if an event comes from a higher cpu (up to CPUS_MAX).
+ */
+#define CPUS_MAX 1024
+
+struct cpu_stat {
+	__u64 submits;
+	__u64 submit_blks;
+	__u64 completes;
+	__u64 complete_blks;
+	struct lhist q2c;
+};
+
+struct cpus_data {
+	__u32 n;
+	struct cpu_stat *cpu;
+	__u64 *matrix;
+
+	GTree *reqs;
+	GPtrArray *done;
+	struct inflight in;
+	struct slab slab;
+
+	char *matrix_f;
+};
+
+static void grow(struct cpus_data *cd, __u32 n)
+{
+	struct cpu_stat *cpu;
+	__u64 *matrix;
+	__u32 i, j;
+
+	if (n <= cd->n)
+		return;
+
+	cpu = g_new0(struct cpu_stat, n);
+	matrix = g_new0(__u64, (gsize)n * n);
+	for (i = 0; i < n; i++)
+		lhist_init(&cpu[i].q2c);
+	for (i = 0; i < cd->n; i++) {
+		lhist_destroy(&cpu[i].q2c);
+		cpu[i] = cd->cpu[i];
+		for (j = 0; j < cd->n; j++)
+			matrix[i * n + j] = cd->matrix[i * cd->n + j];
+	}
+
+	g_free(cd->cpu);
+	g_free(cd->matrix);
+	cd->cpu = cpu;
+	cd->matrix = matrix;
+	cd->n = n;
+}
+
+static void free_cpus(struct cpus_data *cd)
+{
+	__u32 i;
+
+	for (i = 0; i < cd->n; i++)
+		lhist_destroy(&cd->cpu[i].q2c);
+	g_free(cd->cpu);
+	g_free(cd->matrix);
+	cd->cpu = NULL;
+	cd->matrix = NULL;
+	cd->n = 0;
+}
+
+static void insert_c(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+
+	g_tree_insert(cd->reqs, &r->t.sector, r);
+}
+
+static void evict_c(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+
+	g_tree_remove(cd->reqs, &r->t.sector);
+	slab_free(&cd->slab, r);
+}
+
+static void Q(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+	struct inflight_req *r;
+
+	if (!t_blks(t) || t->cpu >= CPUS_MAX)
+		return;
+
+	grow(cd, t->cpu + 1);
+	cd->cpu[t->cpu].submits++;
+	cd->cpu[t->cpu].submit_blks += t_blks(t);
+
+	if (g_tree_lookup(cd->reqs, &t->sector))
+		return;
+
+	r = slab_alloc(&cd->slab);
+	inflight_insert(&cd->in, r, t);
+	insert_c(r, cd);
+
+	inflight_expire(&cd->in, t, evict_c, cd);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+	__u64 first = BIT_START(t);
+	struct inflight_req *r;
+	struct blk_io_trace *qt;
+	guint i;
+
+	if (!t_blks(t) || t->cpu >= CPUS_MAX)
+		return;
+
+	grow(cd, t->cpu + 1);
+	cd->cpu[t->cpu].completes++;
+	cd->cpu[t->cpu].complete_blks += t_blks(t);
+
+	/* the bios of the request, each by the cpu that queued it */
+	inflight_covered(cd->reqs, &first, t, cd->done);
+
+	for (i = 0; i < cd->done->len; i++) {
+		r = g_ptr_array_index(cd->done, i);
+		qt = &r->t;
+
+		cd->matrix[qt->cpu * cd->n + t->cpu]++;
+		if (t->time >= qt->time)
+			lhist_record(&cd->cpu[qt->cpu].q2c, t->time - qt->time);
+
+		g_tree_remove(cd->reqs, &qt->sector);
+		inflight_del(&cd->in, r);
+		slab_free(&cd->slab, r);
+	}
+	g_ptr_array_set_size(cd->done, 0);
+
+	inflight_expire(&cd->in, t, evict_c, cd);
+}
+
+void cpus_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_CPUS(cd1, data1);
+	DECL_ASSIGN_CPUS(cd2, data2);
+	__u32 i, j;
+
+	grow(cd1, cd2->n);
+	for (i = 0; i < cd2->n; i++) {
+		cd1->cpu[i].submits += cd2->cpu[i].submits;
+		cd1->cpu[i].submit_blks += cd2->cpu[i].submit_blks;
+		cd1->cpu[i].completes += cd2->cpu[i].completes;
+		cd1->cpu[i].complete_blks += cd2->cpu[i].complete_blks;
+		lhist_add(&cd1->cpu[i].q2c, &cd2->cpu[i].q2c);
+		for (j = 0; j < cd2->n; j++)
+			cd1->matrix[i * cd1->n + j] +=
+				cd2->matrix[i * cd2->n + j];
+	}
+	cd1->in.unmatched += cd2->in.unmatched;
+}
+
+/* busiest cpu over the average of all of them */
+static double imbalance(const struct cpus_data *cd, gboolean submits)
+{
+	__u64 total = 0, max = 0, v;
+	__u32 i;
+
+	for (i = 0; i < cd->n; i++) {
+		v = submits ? cd->cpu[i].submits : cd->cpu[i].completes;
+		total += v;
+		max = MAX(max, v);
+	}
+
+	return total ? (double)max * cd->n / total : 0;
+}
+
+/* bios completed in a cpu other than the one that queued them */
+static double remote_pct(const struct cpus_data *cd)
+{
+	__u64 total = 0, remote = 0;
+	__u32 i, j;
+
+	for (i = 0; i < cd->n; i++) {
+		for (j = 0; j < cd->n; j++) {
+			total += cd->matrix[i * cd->n + j];
+			if (i != j)
+				remote += cd->matrix[i * cd->n + j];
+		}
+	}
+
+	return total ? 100.0 * remote / total : 0;
+}
+
+void cpus_print_results(const void *data)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+	const struct cpu_stat *c;
+	__u32 i;
+
+	if (!imbalance(cd, TRUE) && !imbalance(cd, FALSE))
+		return;
+
+	printf("CPUs: %u\n", cd->n);
+	printf("CPU submits imbalance: %f (max./avg.)\n", imbalance(cd, TRUE));
+	printf("CPU completions imbalance: %f (max./avg.)\n",
+	       imbalance(cd, FALSE));
+	printf("Remote completions: %.2f%%\n", remote_pct(cd));
+
+	for (i = 0; i < cd->n; i++) {
+		c = &cd->cpu[i];
+		if (!c->submits && !c->completes)
+			continue;
+
+		printf("CPU %u Submits #: %llu (%llu blks)\n", i, c->submits,
+		       c->submit_blks);
+		printf("CPU %u Completions #: %llu (%llu blks)\n", i,
+		       c->completes, c->complete_blks);
+		if (c->q2c.n)
+			printf("CPU %u Q2C p50: %f p99: %f (msec)\n", i,
+			       lhist_quantile(&c->q2c, 0.5) / 1e6,
+			       lhist_quantile(&c->q2c, 0.99) / 1e6);
+	}
+}
+
+void cpus_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+
+	/* the per-cpu values would change the fields of each record */
+	emit_u64(e, "cpus", cd->n);
+	emit_double(e, "cpu_submit_imbalance", imbalance(cd, TRUE));
+	emit_double(e, "cpu_complete_imbalance", imbalance(cd, FALSE));
+	emit_double(e, "cpu_remote_complete_pct", remote_pct(cd));
+}
+
+void cpus_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+	__u32 i, n = cd->in.q.length;
+	GList *l;
+
+	SER_PUT(f, n);
+	for (l = cd->in.q.head; l; l = l->next)
+		ser_write(f, l->data, sizeof(struct blk_io_trace));
+	SER_PUT(f, cd->in.unmatched);
+
+	SER_PUT(f, cd->n);
+	for (i = 0; i < cd->n; i++) {
+		SER_PUT(f, cd->cpu[i].submits);
+		SER_PUT(f, cd->cpu[i].submit_blks);
+		SER_PUT(f, cd->cpu[i].completes);
+		SER_PUT(f, cd->cpu[i].complete_blks);
+		lhist_save(&cd->cpu[i].q2c, f);
+	}
+	ser_write(f, cd->matrix, (size_t)cd->n * cd->n * sizeof(__u64));
+}
+
+void cpus_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+	struct blk_io_trace t;
+	struct inflight_req *r;
+	__u32 i, n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		r = slab_alloc(&cd->slab);
+		inflight_insert(&cd->in, r, &t);
+		insert_c(r, cd);
+	}
+	SER_GET(f, cd->in.unmatched);
+
+	SER_GET(f, n);
+	if (n > CPUS_MAX)
+		error_exit("Truncated or corrupted state file\n");
+	free_cpus(cd);
+	grow(cd, n);
+
+	for (i = 0; i < n; i++) {
+		SER_GET(f, cd->cpu[i].submits);
+		SER_GET(f, cd->cpu[i].submit_blks);
+		SER_GET(f, cd->cpu[i].completes);
+		SER_GET(f, cd->cpu[i].complete_blks);
+		lhist_load(&cd->cpu[i].q2c, f);
+	}
+	ser_read(f, cd->matrix, (size_t)n * n * sizeof(__u64));
+}
+
+void cpus_reset(void *data)
+{
+	DECL_ASSIGN_CPUS(cd, data);
+	__u32 i;
+
+	for (i = 0; i < cd->n; i++) {
+		cd->cpu[i].submits = cd->cpu[i].submit_blks = 0;
+		cd->cpu[i].completes = cd->cpu[i].complete_blks = 0;
+		lhist_reset(&cd->cpu[i].q2c);
+	}
+	memset(cd->matrix, 0, (size_t)cd->n * cd->n * sizeof(__u64));
+	cd->in.unmatched = 0;
+}
+
+void cpus_init(struct plugin *p, struct plugin_set *__unused,
+	       struct plug_args *pa)
+{
+	char filename[FILENAME_MAX];
+	struct cpus_data *cd = p->data = g_new0(struct cpus_data, 1);
+
+	grow(cd, pa && pa->ncpus ? MIN(pa->ncpus, CPUS_MAX) : 1);
+	cd->reqs = g_tree_new(comp_int64);
+	cd->done = g_ptr_array_new();
+	inflight_init(&cd->in, pa);
+	slab_init(&cd->slab, sizeof(struct inflight_req));
+
+	if (pa && pa->cpus_f) {
+		get_filename(filename, "cpus", pa->cpus_f, pa->end_range);
+		cd->matrix_f = g_strdup(filename);
+	}
+}
+
+/* "<Q cpu> <bios completed in cpu 0> .. <bios completed in cpu N>" */
+static void write_matrix(const struct cpus_data *cd)
+{
+	FILE *f = fopen(cd->matrix_f, "w");
+	__u32 i, j;
+
+	if (!f)
+		perror_exit("Opening cpu matrix file");
+
+	for (i = 0; i < cd->n; i++) {
+		fprintf(f, "%u", i);
+		for (j = 0; j < cd->n; j++)
+			fprintf(f, " %llu", cd->matrix[i * cd->n + j]);
+		fprintf(f, "\n");
+	}
+
+	if (fclose(f))
+		perror_exit("Writing cpu matrix file");
+}
+
+void cpus_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_CPUS(cd, p->data);
+
+	if (cd->matrix_f) {
+		write_matrix(cd);
+		g_free(cd->matrix_f);
+	}
+
+	/* the requests are freed with the slab */
+	g_tree_destroy(cd->reqs);
+	g_ptr_array_free(cd->done, TRUE);
+	slab_destroy(&cd->slab);
+	free_cpus(cd);
+	g_free(p->data);
+}
+
+void cpus_ops_init(struct plugin_ops *po)
+{
+	po->add = cpus_add;
+	po->print_results = cpus_print_results;
+	po->emit = cpus_emit;
+	po->save = cpus_save;
+	po->load = cpus_load;
+	po->reset = cpus_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_QUEUE, Q);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
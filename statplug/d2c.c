@@ -1,10 +1,15 @@
 #include <assert.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include <plugins.h>
 #include <blktrace_api.h>
 #include <blktrace.h>
 #include <utils.h>
+#include <serialize.h>
+#include <writer.h>
+#include <lhist.h>
+#include <emit.h>
 
 #include <reqsize.h>
 #include <list_plugins.h>
@@ -17,18 +22,58 @@ struct d2c_data {
 	__u32 processed;
 
 	GTree *prospect_ds;
-	GArray *dtimes;
-	GArray *ctimes;
+
+	/* first D and last C processed in the busy period */
+	__u64 start;
+	__u64 end;
 
 	__u64 d2ctime;
 
 	__u32 maxouts;
 
+	/* D2C time per request, in total and per class of I/O */
+	struct lhist lat;
+	struct lhist class_lat[N_IOC];
+	const struct plugin_set *ps;
+
 	struct reqsize_data *req_dat;
 
-	FILE *detail_f;
+	struct writer *detail_w;
+	gboolean detail_bin;
 };
 
+/* record of the binary detail file */
+struct d2c_detail {
+	__u64 time;
+	__u64 sector;
+	__u64 d2c;
+	__u32 blks;
+	__u32 pad;
+};
+
+static void write_detail(struct d2c_data *d2c, const struct blk_io_trace *t,
+			 __u64 blks, __u64 d2ctime)
+{
+	if (d2c->detail_bin) {
+		struct d2c_detail rec = { t->time, t->sector, d2ctime, blks, 0 };
+
+		writer_write(d2c->detail_w, &rec, sizeof(rec));
+	} else {
+		/* "%f %llu %llu %f\n" */
+		char *p = writer_reserve(d2c->detail_w, 128);
+		size_t n = fmt_sec(p, t->time);
+
+		p[n++] = ' ';
+		n += fmt_u64(p + n, t->sector);
+		p[n++] = ' ';
+		n += fmt_u64(p + n, blks);
+		p[n++] = ' ';
+		n += fmt_sec(p + n, d2ctime);
+		p[n++] = '\n';
+		writer_commit(d2c->detail_w, n);
+	}
+}
+
 static void D(struct blk_io_trace *t, void *data)
 {
 	DECL_ASSIGN_D2C(d2c, data);
@@ -39,58 +84,30 @@ static void D(struct blk_io_trace *t, void *data)
 		DECL_DUP(struct blk_io_trace, new_t, t);
 		g_tree_insert(d2c->prospect_ds, &new_t->sector, new_t);
 		d2c->outstanding++;
+		d2c->maxouts = MAX(d2c->maxouts, d2c->outstanding);
 	}
 }
 
-static void __account_reqs(struct d2c_data *d2c, gboolean finished)
+static void __account_period(struct d2c_data *d2c)
 {
-	d2c->outstanding--;
-	if (d2c->outstanding == 0 || finished) {
-		if (d2c->processed > 0) {
-			unsigned i, j;
-			__u32 outs, maxouts;
-
-			__u64 start, end;
-
-			g_array_sort(d2c->ctimes, comp_int64);
-			g_array_sort(d2c->dtimes, comp_int64);
-
-			i = j = maxouts = outs = 0;
-			while (i < d2c->dtimes->len) {
-				if (g_array_index(d2c->dtimes, __u64, i) <
-				    g_array_index(d2c->ctimes, __u64, j)) {
-					outs++;
-					maxouts = MAX(outs, maxouts);
-					i++;
-				} else {
-					outs--;
-					j++;
-				}
-			}
-
-			d2c->maxouts = MAX(d2c->maxouts, maxouts);
-
-			/* getting d2c time */
-			start = g_array_index(d2c->dtimes, __u64, 0);
-			end = g_array_index(d2c->ctimes, __u64,
-					    d2c->ctimes->len - 1);
-
-			/* adding total time */
-			d2c->d2ctime += end - start;
-
-			/* re-initialize accounters */
-			d2c->processed = 0;
-
-			/* empty arrays */
-			g_array_remove_range(d2c->dtimes, 0, d2c->dtimes->len);
-			g_array_remove_range(d2c->ctimes, 0, d2c->ctimes->len);
-		}
-
-		assert(d2c->processed == 0);
-		assert(d2c->dtimes->len == 0 && d2c->ctimes->len == 0);
+	if (d2c->processed > 0) {
+		/* adding total time */
+		d2c->d2ctime += d2c->end - d2c->start;
+
+		/* re-initialize accounters */
+		d2c->processed = 0;
+		d2c->start = UINT64_MAX;
+		d2c->end = 0;
 	}
 }
 
+static void __account_reqs(struct d2c_data *d2c)
+{
+	d2c->outstanding--;
+	if (d2c->outstanding == 0)
+		__account_period(d2c);
+}
+
 static void C(struct blk_io_trace *t, void *data)
 {
 	DECL_ASSIGN_D2C(d2c, data);
@@ -101,30 +118,24 @@ static void C(struct blk_io_trace *t, void *data)
 
 	if (blks && dtrace) {
 		if (dtrace->bytes == t->bytes) {
-			int e;
-
 			d2c->processed++;
+			lhist_record(&d2c->lat, t->time - dtrace->time);
+			lhist_record(&d2c->class_lat[d2c->ps->ioc],
+				     t->time - dtrace->time);
+
+			/* add detail to file @detail_w */
+			if (d2c->detail_w)
+				write_detail(d2c, t, blks,
+					     t->time - dtrace->time);
 
-			/* add detail to file @detail_f */
-			if (d2c->detail_f) {
-				e = fprintf(d2c->detail_f, "%f %llu %llu %f\n",
-					    NANO_ULL_TO_DOUBLE(t->time),
-					    t->sector, blks,
-					    NANO_ULL_TO_DOUBLE(t->time -
-							       dtrace->time));
-				if (e < 0)
-					error_exit(
-						"Error writing D2C detail file\n");
-			}
-
-			g_array_append_val(d2c->dtimes, dtrace->time);
-			g_array_append_val(d2c->ctimes, t->time);
+			d2c->start = MIN(d2c->start, dtrace->time);
+			d2c->end = MAX(d2c->end, t->time);
 		}
 
 		g_tree_remove(d2c->prospect_ds, &dtrace->sector);
 		g_free(dtrace);
 
-		__account_reqs(d2c, FALSE);
+		__account_reqs(d2c);
 	}
 }
 
@@ -141,7 +152,7 @@ static void R(struct blk_io_trace *t, void *data)
 		g_tree_remove(d2c->prospect_ds, &dtrace->sector);
 		g_free(dtrace);
 
-		__account_reqs(d2c, FALSE);
+		__account_reqs(d2c);
 	}
 }
 
@@ -149,15 +160,20 @@ void d2c_add(void *data1, const void *data2)
 {
 	DECL_ASSIGN_D2C(d2c1, data1);
 	DECL_ASSIGN_D2C(d2c2, data2);
+	unsigned i;
 
 	d2c1->d2ctime += d2c2->d2ctime;
+	d2c1->maxouts = MAX(d2c1->maxouts, d2c2->maxouts);
+	lhist_add(&d2c1->lat, &d2c2->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_add(&d2c1->class_lat[i], &d2c2->class_lat[i]);
 }
 
 void d2c_print_results(const void *data)
 {
 	DECL_ASSIGN_D2C(d2c, data);
 
-	__account_reqs(d2c, TRUE);
+	__account_period(d2c);
 
 	if (d2c->d2ctime > 0) {
 		double t_time_msec = ((double)d2c->d2ctime) / 1e6;
@@ -172,31 +188,123 @@ void d2c_print_results(const void *data)
 		printf("Avg. D2C Throughput: %f (MB/sec)\n",
 		       (t_req_mb) / (t_time_msec / 1000));
 		printf("D2C Max outstanding: %u (reqs)\n", d2c->maxouts);
+		lhist_print(&d2c->lat, "D2C", 1e6, "msec");
+		lhist_print_classes(d2c->class_lat, "D2C", 1e6, "msec");
 	} else
 		printf("Not enough data for D2C stats\n");
 }
 
+void d2c_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_D2C(d2c, data);
+	double t_time_msec, t_req_mb;
+	char key[64];
+	unsigned i;
+
+	__account_period(d2c);
+
+	t_time_msec = ((double)d2c->d2ctime) / 1e6;
+	t_req_mb = ((double)d2c->req_dat->total_size) / (1 << 11);
+
+	emit_double(e, "d2c_total_msec", t_time_msec);
+	emit_double(e, "d2c_avg_msec",
+		    d2c->req_dat->reqs ? t_time_msec / d2c->req_dat->reqs : 0);
+	emit_double(e, "d2c_avg_blk_msec",
+		    d2c->req_dat->total_size ?
+			    t_time_msec / d2c->req_dat->total_size :
+			    0);
+	emit_double(e, "d2c_mb_sec",
+		    d2c->d2ctime ? t_req_mb / (t_time_msec / 1000) : 0);
+	emit_u64(e, "d2c_max_outstanding", d2c->maxouts);
+	lhist_emit(&d2c->lat, e, "d2c_msec", 1e6);
+
+	for (i = 0; i < N_IOC; i++) {
+		emit_class_key(key, sizeof(key), "d2c_msec", i);
+		lhist_emit(&d2c->class_lat[i], e, key, 1e6);
+	}
+}
+
+void d2c_print_row(void *data, __u64 __un1, __u64 __un2)
+{
+	DECL_ASSIGN_D2C(d2c, data);
+
+	printf(" %f %f",
+	       d2c->lat.n ? ((double)d2c->lat.sum) / d2c->lat.n / 1e6 : 0,
+	       lhist_quantile(&d2c->lat, 0.99) / 1e6);
+}
+
+void d2c_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_D2C(d2c, data);
+	unsigned i;
+
+	SER_PUT(f, d2c->outstanding);
+	SER_PUT(f, d2c->processed);
+	ser_put_trace_tree(f, d2c->prospect_ds);
+	SER_PUT(f, d2c->start);
+	SER_PUT(f, d2c->end);
+	SER_PUT(f, d2c->d2ctime);
+	SER_PUT(f, d2c->maxouts);
+	lhist_save(&d2c->lat, f);
+	for (i = 0; i < N_IOC; i++)
+		lhist_save(&d2c->class_lat[i], f);
+}
+
+void d2c_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_D2C(d2c, data);
+	unsigned i;
+
+	SER_GET(f, d2c->outstanding);
+	SER_GET(f, d2c->processed);
+	ser_get_trace_tree(f, d2c->prospect_ds);
+	SER_GET(f, d2c->start);
+	SER_GET(f, d2c->end);
+	SER_GET(f, d2c->d2ctime);
+	SER_GET(f, d2c->maxouts);
+	lhist_load(&d2c->lat, f);
+	for (i = 0; i < N_IOC; i++)
+		lhist_load(&d2c->class_lat[i], f);
+}
+
+void d2c_reset(void *data)
+{
+	DECL_ASSIGN_D2C(d2c, data);
+	unsigned i;
+
+	/* the ongoing busy period is accounted when it finishes */
+	d2c->d2ctime = 0;
+	d2c->maxouts = d2c->outstanding;
+	lhist_reset(&d2c->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_reset(&d2c->class_lat[i]);
+}
+
 void d2c_init(struct plugin *p, struct plugin_set *ps, struct plug_args *pia)
 {
+	unsigned i;
 	char filename[FILENAME_MAX];
 	struct d2c_data *d2c = p->data = g_new(struct d2c_data, 1);
 
 	d2c->outstanding = d2c->processed = 0;
 	d2c->d2ctime = d2c->maxouts = 0;
+	d2c->start = UINT64_MAX;
+	d2c->end = 0;
+	lhist_init(&d2c->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_init(&d2c->class_lat[i]);
+	d2c->ps = ps;
 
 	d2c->prospect_ds = g_tree_new(comp_int64);
-	d2c->dtimes =
-		g_array_sized_new(FALSE, FALSE, sizeof(__u64), TENT_OUTS_RQS);
-	d2c->ctimes =
-		g_array_sized_new(FALSE, FALSE, sizeof(__u64), TENT_OUTS_RQS);
 	d2c->req_dat = ps->plugs[REQ_SIZE_IND].data;
 
 	/* open d2c detail file */
-	d2c->detail_f = NULL;
-	if (pia->d2c_det_f) {
+	d2c->detail_w = NULL;
+	d2c->detail_bin = pia && pia->binary;
+	if (pia && pia->d2c_det_f) {
 		get_filename(filename, "d2c", pia->d2c_det_f, pia->end_range);
-		d2c->detail_f = fopen(filename, "w");
-		if (!d2c->detail_f)
+		d2c->detail_w = writer_open(filename);
+		if (!d2c->detail_w)
 			perror_exit("Opening D2C detail file");
 	}
 }
@@ -204,12 +312,14 @@ void d2c_init(struct plugin *p, struct plugin_set *ps, struct plug_args *pia)
 void d2c_destroy(struct plugin *p)
 {
 	DECL_ASSIGN_D2C(d2c, p->data);
+	unsigned i;
 
 	g_tree_destroy(d2c->prospect_ds);
-	g_array_free(d2c->dtimes, FALSE);
-	g_array_free(d2c->ctimes, FALSE);
-	if (d2c->detail_f)
-		fclose(d2c->detail_f);
+	lhist_destroy(&d2c->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_destroy(&d2c->class_lat[i]);
+	if (d2c->detail_w)
+		writer_close(d2c->detail_w);
 	g_free(p->data);
 }
 
@@ -217,6 +327,12 @@ void d2c_ops_init(struct plugin_ops *po)
 {
 	po->add = d2c_add;
 	po->print_results = d2c_print_results;
+	po->emit = d2c_emit;
+	po->save = d2c_save;
+	po->load = d2c_load;
+	po->reset = d2c_reset;
+	po->row_head = "D2C_avg(msec) D2C_p99(msec)";
+	po->print_row = d2c_print_row;
 
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
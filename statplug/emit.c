@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <math.h>
+#include <glib.h>
+
+#include <utils.h>
+#include <plugins.h>
+#include <writer.h>
+#include <emit.h>
+
+/* the CSV header is printed once, before the first row */
+static gboolean csv_header;
+
+static void emit_str(GString *s, int fmt, const char *str)
+{
+	const char *p;
+
+	if (fmt == OUT_CSV && !strpbrk(str, ",\"\n")) {
+		g_string_append(s, str);
+		return;
+	}
+
+	/* JSON string or quoted CSV field */
+	g_string_append_c(s, '"');
+	for (p = str; *p; p++) {
+		if (*p == '"')
+			g_string_append(s, fmt == OUT_CSV ? "\"\"" : "\\\"");
+		else if (fmt == OUT_JSON && *p == '\\')
+			g_string_append(s, "\\\\");
+		else if (fmt == OUT_JSON && (unsigned char)*p < 0x20) {
+			char esc[8];
+
+			snprintf(esc, sizeof(esc), "\\u%04x", *p);
+			g_string_append(s, esc);
+		} else
+			g_string_append_c(s, *p);
+	}
+	g_string_append_c(s, '"');
+}
+
+static void emit_key(struct emitter *e, const char *key)
+{
+	if (e->fmt == OUT_JSON) {
+		g_string_append(e->buf, ",\"");
+		g_string_append(e->buf, key);
+		g_string_append(e->buf, "\":");
+	} else {
+		g_string_append_c(e->buf, ',');
+		g_string_append_c(e->keys, ',');
+		g_string_append(e->keys, key);
+	}
+}
+
+void emit_begin(struct emitter *e, int fmt, const char *head)
+{
+	e->fmt = fmt;
+	e->buf = g_string_sized_new(4096);
+	e->keys = g_string_sized_new(fmt == OUT_CSV ? 4096 : 0);
+
+	if (fmt == OUT_JSON) {
+		g_string_append(e->buf, "{\"range\":");
+		emit_str(e->buf, fmt, head);
+	} else {
+		g_string_append(e->keys, "range");
+		emit_str(e->buf, fmt, head);
+	}
+}
+
+void emit_end(struct emitter *e)
+{
+	GString *out = e->buf;
+
+	g_string_append(e->buf, e->fmt == OUT_JSON ? "}\n" : "\n");
+
+	if (e->fmt == OUT_CSV && !csv_header) {
+		g_string_append_c(e->keys, '\n');
+		out = g_string_append_len(e->keys, e->buf->str, e->buf->len);
+		csv_header = TRUE;
+	}
+
+	/* text of other prints first, then the record in a single write */
+	fflush(stdout);
+	if (fwrite(out->str, out->len, 1, stdout) != 1 || fflush(stdout))
+		perror_exit("Writing the output");
+
+	g_string_free(e->buf, TRUE);
+	g_string_free(e->keys, TRUE);
+}
+
+void emit_u64(struct emitter *e, const char *key, __u64 v)
+{
+	char num[20];
+
+	emit_key(e, key);
+	g_string_append_len(e->buf, num, fmt_u64(num, v));
+}
+
+void emit_double(struct emitter *e, const char *key, double v)
+{
+	char num[G_ASCII_DTOSTR_BUF_SIZE];
+
+	emit_key(e, key);
+	if (isfinite(v))
+		g_string_append(e->buf, g_ascii_formatd(num, sizeof(num),
+							"%.6f", v));
+	else if (e->fmt == OUT_JSON)
+		g_string_append(e->buf, "null");
+}
+
+void emit_string(struct emitter *e, const char *key, const char *v)
+{
+	emit_key(e, key);
+	emit_str(e->buf, e->fmt, v);
+}
+
+void emit_class_key(char *key, size_t len, const char *prefix, unsigned ioc)
+{
+	char *p;
+
+	snprintf(key, len, "%s_%s", prefix, io_class_name[ioc]);
+	for (p = key; *p; p++)
+		if (*p == ' ')
+			*p = '_';
+}
@@ -0,0 +1,36 @@
+#ifndef _EMIT_H_
+#define _EMIT_H_
+
+#include <glib.h>
+
+#include <blktrace_api.h>
+
+/*
+ * Structured output of the stats of a range: the plugins emit typed
+ * key/value fields and the record is written as a JSON line or a CSV row
+ * (with a header before the first row). The record is formatted in a
+ * buffer, independently of the locale, and written at once.
+ */
+
+enum { OUT_TEXT, OUT_JSON, OUT_CSV };
+
+struct emitter {
+	int fmt;
+
+	/* record being formatted and, for CSV, its keys */
+	GString *buf;
+	GString *keys;
+};
+
+void emit_begin(struct emitter *e, int fmt, const char *head);
+void emit_end(struct emitter *e);
+
+void emit_u64(struct emitter *e, const char *key, __u64 v);
+void emit_double(struct emitter *e, const char *key, double v);
+void emit_string(struct emitter *e, const char *key, const char *v);
+
+/* the fields are the same in every record (0 when there is no data), so
+ * keys of classes of I/O are built by the caller with this */
+void emit_class_key(char *key, size_t len, const char *prefix, unsigned ioc);
+
+#endif
@@ -0,0 +1,457 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <slab.h>
+#include <lhist.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_FLUSH(name, data) \
+	struct flush_data *name = (struct flush_data *)data
+
+/*
+ * Cost of flushes and FUA writes: the Q2C of the zero-length flushes and
+ * of the FUA writes, how often flushes come, and the Q2C of the other
+ * bios depending on whether a flush was outstanding when they were
+ * queued. That is decided once, at the Q, from the flushes in flight
+ * (which also count the bios queued behind the last of them), so no
+ * table is scanned at the completions.
+ *
+ * Flushes have no sector to match, so they are kept in arrival order. The
+ * block layer completes with one flush all the ones pending when it was
+ * issued: each flush D takes the flushes queued since the previous one,
+ * and each completion ends the flushes of the oldest D (or the oldest
+ * flush without one).
+ */
+
+struct flush_req {
+	struct inflight_req r;
+
+	/* bio: queued behind a flush. flush: bios queued behind it */
+	__u64 behind;
+};
+
+struct flush_data {
+	struct plugin_set *ps;
+
+	/* bios other than flushes, by sector */
+	GTree *reqs;
+	struct inflight in;
+	GPtrArray *done;
+
+	/* flushes, oldest first, the first @issued of them in the batches
+	 * of the flush Ds in flight */
+	struct inflight flushes;
+	__u32 issued;
+	GQueue batches;
+
+	struct slab slab;
+
+	/* time covered by the events and last flush queued */
+	__u64 span;
+	__u64 last;
+	__u64 last_flush;
+
+	struct lhist flush_lat;
+	struct lhist fua_lat;
+	struct lhist interval;
+	struct lhist behind_n;
+	struct lhist behind_lat;
+	struct lhist clear_lat;
+};
+
+static void advance(struct flush_data *fd, __u64 time)
+{
+	if (fd->last && time > fd->last)
+		fd->span += time - fd->last;
+	fd->last = MAX(fd->last, time);
+}
+
+static void insert_r(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+
+	g_tree_insert(fd->reqs, &r->t.sector, r);
+}
+
+static void evict_r(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+
+	g_tree_remove(fd->reqs, &r->t.sector);
+	slab_free(&fd->slab, r);
+}
+
+static void evict_flush(struct inflight_req *r,
+			const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+
+	if (fd->issued)
+		fd->issued--;
+	slab_free(&fd->slab, r);
+}
+
+static void Q_flush(struct flush_data *fd, struct blk_io_trace *t)
+{
+	struct flush_req *fr = slab_alloc(&fd->slab);
+
+	if (fd->last_flush && t->time >= fd->last_flush)
+		lhist_record(&fd->interval, t->time - fd->last_flush);
+	fd->last_flush = t->time;
+
+	inflight_insert(&fd->flushes, &fr->r, t);
+	fr->behind = 0;
+
+	inflight_expire(&fd->flushes, t, evict_flush, fd);
+}
+
+static void Q(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+	struct flush_req *fr, *last;
+
+	advance(fd, t->time);
+
+	if (fd->ps->ioc == IOC_FLUSH) {
+		Q_flush(fd, t);
+		return;
+	}
+
+	if (!t_blks(t) || g_tree_lookup(fd->reqs, &t->sector))
+		return;
+
+	fr = slab_alloc(&fd->slab);
+	inflight_insert(&fd->in, &fr->r, t);
+	insert_r(&fr->r, fd);
+
+	fr->behind = fd->flushes.q.length > 0;
+	if (fr->behind) {
+		last = fd->flushes.q.tail->data;
+		last->behind++;
+	}
+
+	inflight_expire(&fd->in, t, evict_r, fd);
+}
+
+static void D(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+	__u32 n = fd->flushes.q.length;
+
+	if (fd->ps->ioc != IOC_FLUSH || n <= fd->issued)
+		return;
+
+	g_queue_push_tail(&fd->batches, GUINT_TO_POINTER(n - fd->issued));
+	fd->issued = n;
+}
+
+static void C_flush(struct flush_data *fd, struct blk_io_trace *t)
+{
+	__u32 n = 1;
+	struct flush_req *fr;
+
+	if (fd->batches.length)
+		n = GPOINTER_TO_UINT(g_queue_pop_head(&fd->batches));
+
+	while (n-- && fd->flushes.q.head) {
+		fr = fd->flushes.q.head->data;
+		if (t->time >= fr->r.t.time)
+			lhist_record(&fd->flush_lat, t->time - fr->r.t.time);
+		lhist_record(&fd->behind_n, fr->behind);
+
+		inflight_del(&fd->flushes, &fr->r);
+		slab_free(&fd->slab, fr);
+		if (fd->issued)
+			fd->issued--;
+	}
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+	__u64 first = BIT_START(t), lat;
+	struct flush_req *fr;
+	struct blk_io_trace *qt;
+	guint i;
+
+	advance(fd, t->time);
+
+	if (fd->ps->ioc == IOC_FLUSH) {
+		C_flush(fd, t);
+		return;
+	}
+
+	if (!t_blks(t))
+		return;
+
+	/* the bios of the request */
+	inflight_covered(fd->reqs, &first, t, fd->done);
+
+	for (i = 0; i < fd->done->len; i++) {
+		fr = g_ptr_array_index(fd->done, i);
+		qt = &fr->r.t;
+
+		if (t->time >= qt->time) {
+			lat = t->time - qt->time;
+			lhist_record(fr->behind ? &fd->behind_lat :
+						  &fd->clear_lat,
+				     lat);
+			if (fd->ps->ioc == IOC_WRITE_FUA)
+				lhist_record(&fd->fua_lat, lat);
+		}
+
+		g_tree_remove(fd->reqs, &qt->sector);
+		inflight_del(&fd->in, &fr->r);
+		slab_free(&fd->slab, fr);
+	}
+	g_ptr_array_set_size(fd->done, 0);
+
+	inflight_expire(&fd->in, t, evict_r, fd);
+}
+
+void flush_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_FLUSH(fd1, data1);
+	DECL_ASSIGN_FLUSH(fd2, data2);
+
+	fd1->span += fd2->span;
+	lhist_add(&fd1->flush_lat, &fd2->flush_lat);
+	lhist_add(&fd1->fua_lat, &fd2->fua_lat);
+	lhist_add(&fd1->interval, &fd2->interval);
+	lhist_add(&fd1->behind_n, &fd2->behind_n);
+	lhist_add(&fd1->behind_lat, &fd2->behind_lat);
+	lhist_add(&fd1->clear_lat, &fd2->clear_lat);
+	fd1->in.unmatched += fd2->in.unmatched;
+	fd1->flushes.unmatched += fd2->flushes.unmatched;
+}
+
+static double avg(const struct lhist *h)
+{
+	return h->n ? (double)h->sum / h->n : 0;
+}
+
+static double flush_rate(const struct flush_data *fd)
+{
+	return fd->span ? fd->flush_lat.n / ((double)fd->span / 1e9) : 0;
+}
+
+/* extra Q2C of the bios queued behind a flush */
+static double delay(const struct flush_data *fd)
+{
+	return fd->behind_lat.n && fd->clear_lat.n ?
+		       avg(&fd->behind_lat) - avg(&fd->clear_lat) :
+		       0;
+}
+
+void flush_print_results(const void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+
+	__u64 bios = fd->behind_lat.n + fd->clear_lat.n;
+
+	if (fd->flush_lat.n) {
+		printf("Flushes #: %llu\n", fd->flush_lat.n);
+		printf("Flush rate: %f (/sec)\n", flush_rate(fd));
+		printf("Avg. flush interval: %f (msec)\n",
+		       avg(&fd->interval) / 1e6);
+		printf("Avg. flush Q2C: %f (msec)\n",
+		       avg(&fd->flush_lat) / 1e6);
+		printf("Flushes unmatched #: %llu\n", fd->flushes.unmatched);
+		lhist_print(&fd->flush_lat, "Flush Q2C", 1e6, "msec");
+		printf("Bios behind a flush #: %llu (%.2f%%)\n",
+		       fd->behind_lat.n,
+		       bios ? 100.0 * fd->behind_lat.n / bios : 0);
+		printf("Bios behind per flush avg: %f max: %llu\n",
+		       avg(&fd->behind_n), fd->behind_n.max);
+		printf("Avg. Q2C behind a flush: %f (msec)\n",
+		       avg(&fd->behind_lat) / 1e6);
+		printf("Avg. Q2C clear of flushes: %f (msec)\n",
+		       avg(&fd->clear_lat) / 1e6);
+		printf("Flush delay: %f (msec)\n", delay(fd) / 1e6);
+		lhist_print(&fd->behind_lat, "Q2C behind flush", 1e6, "msec");
+	}
+
+	if (fd->fua_lat.n) {
+		printf("FUA writes #: %llu\n", fd->fua_lat.n);
+		printf("Avg. FUA Q2C: %f (msec)\n", avg(&fd->fua_lat) / 1e6);
+		lhist_print(&fd->fua_lat, "FUA Q2C", 1e6, "msec");
+	}
+}
+
+void flush_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+
+	emit_u64(e, "flushes", fd->flush_lat.n);
+	emit_double(e, "flushes_sec", flush_rate(fd));
+	lhist_emit(&fd->flush_lat, e, "flush_msec", 1e6);
+	emit_double(e, "flush_behind_avg", avg(&fd->behind_n));
+	emit_double(e, "flush_delay_msec", delay(fd) / 1e6);
+	emit_u64(e, "fua_writes", fd->fua_lat.n);
+	lhist_emit(&fd->fua_lat, e, "fua_msec", 1e6);
+}
+
+static void save_reqs(const struct inflight *in, FILE *f)
+{
+	const struct flush_req *fr;
+	__u32 n = in->q.length;
+	GList *l;
+
+	SER_PUT(f, n);
+	for (l = in->q.head; l; l = l->next) {
+		fr = l->data;
+		ser_write(f, &fr->r.t, sizeof(struct blk_io_trace));
+		SER_PUT(f, fr->behind);
+	}
+	SER_PUT(f, in->unmatched);
+}
+
+static void load_reqs(struct flush_data *fd, struct inflight *in, FILE *f,
+		      gboolean index)
+{
+	struct blk_io_trace t;
+	struct flush_req *fr;
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		fr = slab_alloc(&fd->slab);
+		inflight_insert(in, &fr->r, &t);
+		SER_GET(f, fr->behind);
+		if (index)
+			insert_r(&fr->r, fd);
+	}
+	SER_GET(f, in->unmatched);
+}
+
+void flush_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+	__u32 n, b;
+	GList *l;
+
+	save_reqs(&fd->in, f);
+	save_reqs(&fd->flushes, f);
+	SER_PUT(f, fd->issued);
+	n = fd->batches.length;
+	SER_PUT(f, n);
+	for (l = fd->batches.head; l; l = l->next) {
+		b = GPOINTER_TO_UINT(l->data);
+		SER_PUT(f, b);
+	}
+	SER_PUT(f, fd->span);
+	SER_PUT(f, fd->last);
+	SER_PUT(f, fd->last_flush);
+
+	lhist_save(&fd->flush_lat, f);
+	lhist_save(&fd->fua_lat, f);
+	lhist_save(&fd->interval, f);
+	lhist_save(&fd->behind_n, f);
+	lhist_save(&fd->behind_lat, f);
+	lhist_save(&fd->clear_lat, f);
+}
+
+void flush_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+	__u32 n, b;
+
+	load_reqs(fd, &fd->in, f, TRUE);
+	load_reqs(fd, &fd->flushes, f, FALSE);
+	SER_GET(f, fd->issued);
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, b);
+		g_queue_push_tail(&fd->batches, GUINT_TO_POINTER(b));
+	}
+	SER_GET(f, fd->span);
+	SER_GET(f, fd->last);
+	SER_GET(f, fd->last_flush);
+
+	lhist_load(&fd->flush_lat, f);
+	lhist_load(&fd->fua_lat, f);
+	lhist_load(&fd->interval, f);
+	lhist_load(&fd->behind_n, f);
+	lhist_load(&fd->behind_lat, f);
+	lhist_load(&fd->clear_lat, f);
+}
+
+void flush_reset(void *data)
+{
+	DECL_ASSIGN_FLUSH(fd, data);
+
+	/* the requests in flight and the last flush are kept */
+	fd->span = 0;
+	lhist_reset(&fd->flush_lat);
+	lhist_reset(&fd->fua_lat);
+	lhist_reset(&fd->interval);
+	lhist_reset(&fd->behind_n);
+	lhist_reset(&fd->behind_lat);
+	lhist_reset(&fd->clear_lat);
+	fd->in.unmatched = 0;
+	fd->flushes.unmatched = 0;
+}
+
+void flush_init(struct plugin *p, struct plugin_set *ps,
+		struct plug_args *pa)
+{
+	struct flush_data *fd = p->data = g_new0(struct flush_data, 1);
+
+	fd->ps = ps;
+	fd->reqs = g_tree_new(comp_int64);
+	inflight_init(&fd->in, pa);
+	inflight_init(&fd->flushes, pa);
+	g_queue_init(&fd->batches);
+	fd->done = g_ptr_array_new();
+	slab_init(&fd->slab, sizeof(struct flush_req));
+
+	lhist_init(&fd->flush_lat);
+	lhist_init(&fd->fua_lat);
+	lhist_init(&fd->interval);
+	lhist_init(&fd->behind_n);
+	lhist_init(&fd->behind_lat);
+	lhist_init(&fd->clear_lat);
+}
+
+void flush_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_FLUSH(fd, p->data);
+
+	/* the requests and flushes are freed with the slab */
+	g_tree_destroy(fd->reqs);
+	g_ptr_array_free(fd->done, TRUE);
+	slab_destroy(&fd->slab);
+	g_queue_clear(&fd->batches);
+
+	lhist_destroy(&fd->flush_lat);
+	lhist_destroy(&fd->fua_lat);
+	lhist_destroy(&fd->interval);
+	lhist_destroy(&fd->behind_n);
+	lhist_destroy(&fd->behind_lat);
+	lhist_destroy(&fd->clear_lat);
+	g_free(p->data);
+}
+
+void flush_ops_init(struct plugin_ops *po)
+{
+	po->add = flush_add;
+	po->print_results = flush_print_results;
+	po->emit = flush_emit;
+	po->save = flush_save;
+	po->load = flush_load;
+	po->reset = flush_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_QUEUE, Q);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
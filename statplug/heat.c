@@ -0,0 +1,442 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <slab.h>
+#include <writer.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_HEAT(name, data) \
+	struct heat_data *name = (struct heat_data *)data
+
+/*
+ * Requests per band of sectors. The bands have 2^shift sectors, starting
+ * with one sector and doubling (adding up pairs of bands) when a sector
+ * beyond the last band is seen, so two heatmaps always merge exactly.
+ * The D2C time of each band is kept in log2 buckets of usecs, for the p99
+ * of the slowest one.
+ */
+#define HEAT_BANDS 4096
+#define HEAT_LAT 24
+
+struct heat_band {
+	__u64 ops;
+	__u64 blks;
+	__u64 lat_n;
+	__u64 lat_sum;
+	__u32 lat[HEAT_LAT];
+};
+
+/* request issued, indexed by sector */
+struct heat_req {
+	struct inflight_req r;
+};
+
+struct heat_data {
+	__u32 n;
+	__u32 shift;
+	struct heat_band *bands;
+
+	GTree *reqs;
+	struct inflight in;
+	struct slab slab;
+
+	/* band x time matrix: ops per band of the current bucket */
+	struct writer *w;
+	gboolean bin;
+	__u64 res;
+	__u64 bucket;
+	__u32 *row;
+};
+
+static unsigned lat_bucket(__u64 ns)
+{
+	__u64 us = ns / 1000;
+
+	return us ? MIN(HEAT_LAT - 1, 64 - __builtin_clzll(us)) : 0;
+}
+
+static void write_row(struct heat_data *heat)
+{
+	__u64 hdr[2] = { heat->bucket, 1ULL << heat->shift };
+	unsigned i;
+	size_t n;
+	char *p;
+
+	if (heat->bin) {
+		writer_write(heat->w, hdr, sizeof(hdr));
+		writer_write(heat->w, heat->row, heat->n * sizeof(__u32));
+	} else {
+		/* "<bucket start> <band blks> <ops> .. <ops>" */
+		p = writer_reserve(heat->w, 64 + heat->n * 11);
+		n = fmt_sec(p, heat->bucket);
+		p[n++] = ' ';
+		n += fmt_u64(p + n, 1ULL << heat->shift);
+		for (i = 0; i < heat->n; i++) {
+			p[n++] = ' ';
+			n += fmt_u64(p + n, heat->row[i]);
+		}
+		p[n++] = '\n';
+		writer_commit(heat->w, n);
+	}
+
+	memset(heat->row, 0, heat->n * sizeof(__u32));
+}
+
+/* double the size of the bands */
+static void fold(struct heat_data *heat)
+{
+	struct heat_band *b = heat->bands;
+	unsigned i, j;
+
+	for (i = 1; i < heat->n; i++) {
+		b[i / 2].ops += b[i].ops;
+		b[i / 2].blks += b[i].blks;
+		b[i / 2].lat_n += b[i].lat_n;
+		b[i / 2].lat_sum += b[i].lat_sum;
+		for (j = 0; j < HEAT_LAT; j++)
+			b[i / 2].lat[j] += b[i].lat[j];
+		memset(&b[i], 0, sizeof(b[i]));
+	}
+
+	/* the band of the current row too, if any */
+	if (heat->row) {
+		for (i = 1; i < heat->n; i++) {
+			heat->row[i / 2] += heat->row[i];
+			heat->row[i] = 0;
+		}
+	}
+
+	heat->shift++;
+}
+
+/* a set without any request takes the number of bands of another */
+static void set_bands(struct heat_data *heat, __u32 n)
+{
+	unsigned i;
+
+	for (i = 0; i < heat->n; i++)
+		if (heat->bands[i].ops)
+			error_exit("Heatmaps with different number of bands\n");
+
+	g_free(heat->bands);
+	heat->n = n;
+	heat->bands = g_new0(struct heat_band, n);
+}
+
+static unsigned band(struct heat_data *heat, __u64 sector)
+{
+	while ((sector >> heat->shift) >= heat->n)
+		fold(heat);
+
+	return sector >> heat->shift;
+}
+
+static void insert_h(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+
+	g_tree_insert(heat->reqs, &r->t.sector, r);
+}
+
+static void evict_h(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+
+	g_tree_remove(heat->reqs, &r->t.sector);
+	slab_free(&heat->slab, r);
+}
+
+static void D(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+	struct heat_req *hr;
+
+	if (!t_blks(t) || g_tree_lookup(heat->reqs, &t->sector))
+		return;
+
+	hr = slab_alloc(&heat->slab);
+	inflight_insert(&heat->in, &hr->r, t);
+	insert_h(&hr->r, heat);
+
+	inflight_expire(&heat->in, t, evict_h, heat);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+	struct heat_req *hr;
+	struct heat_band *b;
+	unsigned i;
+
+	if (!t_blks(t))
+		return;
+
+	if (heat->w) {
+		if (heat->bucket == UINT64_MAX)
+			heat->bucket = t->time - t->time % heat->res;
+		if (t->time >= heat->bucket + heat->res) {
+			write_row(heat);
+			heat->bucket = t->time - t->time % heat->res;
+		}
+	}
+
+	i = band(heat, t->sector);
+	b = &heat->bands[i];
+	b->ops++;
+	b->blks += t_blks(t);
+	if (heat->row)
+		heat->row[i]++;
+
+	hr = g_tree_lookup(heat->reqs, &t->sector);
+	if (hr) {
+		if (t->time >= hr->r.t.time) {
+			b->lat_n++;
+			b->lat_sum += t->time - hr->r.t.time;
+			b->lat[lat_bucket(t->time - hr->r.t.time)]++;
+		}
+
+		g_tree_remove(heat->reqs, &t->sector);
+		inflight_del(&heat->in, &hr->r);
+		slab_free(&heat->slab, hr);
+	}
+
+	inflight_expire(&heat->in, t, evict_h, heat);
+}
+
+void heat_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_HEAT(heat1, data1);
+	DECL_ASSIGN_HEAT(heat2, data2);
+	const struct heat_band *b2;
+	struct heat_band *b1;
+	unsigned i, j;
+
+	if (heat1->n != heat2->n)
+		set_bands(heat1, heat2->n);
+
+	while (heat1->shift < heat2->shift)
+		fold(heat1);
+
+	for (i = 0; i < heat2->n; i++) {
+		b2 = &heat2->bands[i];
+		if (!b2->ops)
+			continue;
+
+		b1 = &heat1->bands[i >> (heat1->shift - heat2->shift)];
+		b1->ops += b2->ops;
+		b1->blks += b2->blks;
+		b1->lat_n += b2->lat_n;
+		b1->lat_sum += b2->lat_sum;
+		for (j = 0; j < HEAT_LAT; j++)
+			b1->lat[j] += b2->lat[j];
+	}
+}
+
+/* band with the most requests and band with the highest average D2C */
+static void hot_slow(const struct heat_data *heat, unsigned *hot,
+		     unsigned *slow, __u64 *ops)
+{
+	const struct heat_band *b = heat->bands;
+	unsigned i;
+
+	*hot = *slow = 0;
+	*ops = 0;
+	for (i = 0; i < heat->n; i++) {
+		*ops += b[i].ops;
+		if (b[i].ops > b[*hot].ops)
+			*hot = i;
+		if (b[i].lat_n &&
+		    (!b[*slow].lat_n || (double)b[i].lat_sum / b[i].lat_n >
+						(double)b[*slow].lat_sum /
+							b[*slow].lat_n))
+			*slow = i;
+	}
+}
+
+static double avg_msec(const struct heat_band *b)
+{
+	return b->lat_n ? (double)b->lat_sum / b->lat_n / 1e6 : 0;
+}
+
+/* upper bound of the log2 bucket with the @q quantile of the D2C */
+static double quantile_msec(const struct heat_band *b, double q)
+{
+	__u64 n = 0;
+	unsigned i;
+
+	if (!b->lat_n)
+		return 0;
+
+	for (i = 0; i < HEAT_LAT - 1; i++) {
+		n += b->lat[i];
+		if (n >= q * b->lat_n)
+			break;
+	}
+
+	return (double)(1ULL << i) / 1e3;
+}
+
+void heat_print_results(const void *data)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+	unsigned hot, slow;
+	__u64 ops;
+
+	hot_slow(heat, &hot, &slow, &ops);
+	if (!ops)
+		return;
+
+	printf("LBA bands: %u of %llu (blks)\n", heat->n, 1ULL << heat->shift);
+	printf("LBA hottest band: %u (%.1f%% reqs)\n", hot,
+	       100.0 * heat->bands[hot].ops / ops);
+	printf("LBA slowest band: %u\n", slow);
+	printf("LBA slowest band Avg. D2C: %f (msec)\n",
+	       avg_msec(&heat->bands[slow]));
+	printf("LBA slowest band D2C p99: %f (msec)\n",
+	       quantile_msec(&heat->bands[slow], 0.99));
+}
+
+void heat_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+	unsigned hot, slow;
+	__u64 ops;
+
+	hot_slow(heat, &hot, &slow, &ops);
+	emit_u64(e, "heat_bands", heat->n);
+	emit_u64(e, "heat_band_blks", 1ULL << heat->shift);
+	emit_u64(e, "heat_hot_band", hot);
+	emit_u64(e, "heat_hot_reqs", heat->bands[hot].ops);
+	emit_u64(e, "heat_slow_band", slow);
+	emit_double(e, "heat_slow_d2c_msec", avg_msec(&heat->bands[slow]));
+	emit_double(e, "heat_slow_d2c_p99_msec",
+		    quantile_msec(&heat->bands[slow], 0.99));
+}
+
+void heat_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+	__u32 i, used = 0, n = heat->in.q.length;
+	GList *l;
+
+	SER_PUT(f, n);
+	for (l = heat->in.q.head; l; l = l->next)
+		ser_write(f, l->data, sizeof(struct blk_io_trace));
+	SER_PUT(f, heat->in.unmatched);
+
+	/* only the bands in use */
+	SER_PUT(f, heat->n);
+	SER_PUT(f, heat->shift);
+	for (i = 0; i < heat->n; i++)
+		used += heat->bands[i].ops != 0;
+	SER_PUT(f, used);
+	for (i = 0; i < heat->n; i++) {
+		if (heat->bands[i].ops) {
+			SER_PUT(f, i);
+			SER_PUT(f, heat->bands[i]);
+		}
+	}
+}
+
+void heat_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+	struct blk_io_trace t;
+	struct heat_req *hr;
+	__u32 i, n, used;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		hr = slab_alloc(&heat->slab);
+		inflight_insert(&heat->in, &hr->r, &t);
+		insert_h(&hr->r, heat);
+	}
+	SER_GET(f, heat->in.unmatched);
+
+	SER_GET(f, n);
+	memset(heat->bands, 0, heat->n * sizeof(struct heat_band));
+	if (n != heat->n)
+		set_bands(heat, n);
+	SER_GET(f, heat->shift);
+	SER_GET(f, used);
+	while (used--) {
+		SER_GET(f, i);
+		if (i >= heat->n)
+			error_exit("Truncated or corrupted state file\n");
+		SER_GET(f, heat->bands[i]);
+	}
+}
+
+void heat_reset(void *data)
+{
+	DECL_ASSIGN_HEAT(heat, data);
+
+	/* the bands keep their size */
+	memset(heat->bands, 0, heat->n * sizeof(struct heat_band));
+	heat->in.unmatched = 0;
+}
+
+void heat_init(struct plugin *p, struct plugin_set *__unused,
+	       struct plug_args *pa)
+{
+	char filename[FILENAME_MAX];
+	struct heat_data *heat = p->data = g_new0(struct heat_data, 1);
+
+	heat->n = pa && pa->heat_bands ? pa->heat_bands : HEAT_BANDS;
+	heat->bands = g_new0(struct heat_band, heat->n);
+	heat->reqs = g_tree_new(comp_int64);
+	inflight_init(&heat->in, pa);
+	slab_init(&heat->slab, sizeof(struct heat_req));
+
+	heat->bucket = UINT64_MAX;
+	if (pa && pa->heat_f) {
+		get_filename(filename, "heat", pa->heat_f, pa->end_range);
+		heat->w = writer_open(filename);
+		if (!heat->w)
+			perror_exit("Opening heatmap file");
+		heat->bin = pa->binary;
+		heat->res = pa->heat_res;
+		heat->row = g_new0(__u32, heat->n);
+	}
+}
+
+void heat_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_HEAT(heat, p->data);
+
+	if (heat->w) {
+		if (heat->bucket != UINT64_MAX)
+			write_row(heat);
+		writer_close(heat->w);
+		g_free(heat->row);
+	}
+
+	/* the requests are freed with the slab */
+	g_tree_destroy(heat->reqs);
+	slab_destroy(&heat->slab);
+	g_free(heat->bands);
+	g_free(p->data);
+}
+
+void heat_ops_init(struct plugin_ops *po)
+{
+	po->add = heat_add;
+	po->print_results = heat_print_results;
+	po->emit = heat_emit;
+	po->save = heat_save;
+	po->load = heat_load;
+	po->reset = heat_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
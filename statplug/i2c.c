@@ -1,6 +1,7 @@
 #include <asm/types.h>
 #include <glib.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <float.h>
@@ -13,6 +14,10 @@
 #include <utils.h>
 #include <list_plugins.h>
 #include <reqsize.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <writer.h>
+#include <emit.h>
 
 #define DECL_ASSIGN_I2C(name, data) \
 	struct i2c_data *name = (struct i2c_data *)data
@@ -22,126 +27,331 @@
 #define N_BINS (21)
 #define BINS_SEP (8)
 
-struct oio_data {
 #define READ 0
 #define WRITE 1
-	gsl_histogram *op[2];
+
+/* a row of the oio matrix holds the size bins of reads followed by the
+ * ones of writes for one oio level. Rows are padded to cache lines. */
+#define CACHE_LINE (64)
+#define ALIGN(x, a) (((x) + (a)-1) / (a) * (a))
+#define ROW_LEN (ALIGN(2 * N_BINS, CACHE_LINE / sizeof(__u64)))
+
+#define OIO_ROW(i2c, oio) ((i2c)->oio_hist + (size_t)(oio)*ROW_LEN)
+
+/* state of the oio timeline (see plugins.h) */
+struct oio_timeline {
+	struct writer *w;
+	int mode;
+	gboolean bin;
+	__u64 res;
+
+	/* last change seen, not written yet */
+	gboolean pending;
 	__u64 time;
+	__u32 oio;
+	__u32 written;
+
+	/* current bucket: start, since when it is covered and oio
+	 * integral over time */
+	__u64 start;
+	__u64 from;
+	__u32 min;
+	__u32 max;
+	double area;
 };
 
 struct i2c_data {
 	GTree *is;
-	FILE *oio_f;
+	struct inflight in;
+	struct oio_timeline tl;
 
 	__u32 outstanding;
 	__u32 maxouts;
 
-	/* oio hist */
-	struct oio_data *oio;
+	/* oio hist: time spent and requests seen (oio_size x ROW_LEN
+	 * matrix) in each oio level */
+	__u64 *oio_time;
+	__u64 *oio_hist;
 	__u32 oio_size;
 	__u64 oio_prev_time;
 	FILE *oio_hist_f;
+
+	/* requests in @is per size bin, laid out as a row of @oio_hist */
+	__u64 inflight[ROW_LEN];
+
+	/* oio per class of I/O: current, max. and integral over time */
+	__u32 class_outs[N_IOC];
+	__u32 class_max[N_IOC];
+	__u64 class_area[N_IOC];
 };
 
-static void write_outs(struct i2c_data *i2c, struct blk_io_trace *t)
+static void write_change(struct oio_timeline *tl, __u64 time, __u32 oio)
 {
-	if (i2c->oio_f)
-		fprintf(i2c->oio_f, "%f %u\n", NANO_ULL_TO_DOUBLE(t->time),
-			i2c->outstanding);
+	if (tl->bin) {
+		struct {
+			__u64 time;
+			__u32 oio;
+			__u32 pad;
+		} rec = { time, oio, 0 };
+
+		writer_write(tl->w, &rec, sizeof(rec));
+	} else {
+		char *p = writer_reserve(tl->w, 64);
+		size_t n = fmt_sec(p, time);
+
+		p[n++] = ' ';
+		n += fmt_u64(p + n, oio);
+		p[n++] = '\n';
+		writer_commit(tl->w, n);
+	}
+	tl->written = oio;
 }
 
-static gsl_histogram *new_hist()
+static void write_bucket(struct oio_timeline *tl, __u64 end)
 {
-	gsl_histogram *h;
+	double avg = end > tl->from ? tl->area / (end - tl->from) : tl->oio;
 
-	/* allocate bins and set ranges uniformally */
-	h = gsl_histogram_alloc(N_BINS);
-	gsl_histogram_set_ranges_uniform(h, 0, N_BINS * BINS_SEP);
+	if (tl->bin) {
+		struct {
+			__u64 start;
+			__u32 min;
+			__u32 max;
+			double avg;
+		} rec = { tl->start, tl->min, tl->max, avg };
 
-	/* last bin should hold everything greater
-	 * than (N_BINS-1)*BINS_SEP */
-	h->range[h->n] = DBL_MAX;
+		writer_write(tl->w, &rec, sizeof(rec));
+	} else {
+		char *p = writer_reserve(tl->w, 128);
+		size_t n = fmt_sec(p, tl->start);
 
-	return h;
+		n += sprintf(p + n, " %u %.2f %u\n", tl->min, avg, tl->max);
+		writer_commit(tl->w, n);
+	}
 }
 
-static void init_oio_data(struct oio_data *oio, int n)
+static void write_outs(struct i2c_data *i2c, const struct blk_io_trace *t)
 {
-	int i;
+	struct oio_timeline *tl = &i2c->tl;
+	__u64 end;
+
+	if (!tl->w)
+		return;
+
+	switch (tl->mode) {
+	case OIO_ALL:
+		write_change(tl, t->time, i2c->outstanding);
+		return;
+	case OIO_CHANGES:
+		/* only the last change of a timestamp, if it changes */
+		if (tl->pending && tl->time != t->time &&
+		    tl->oio != tl->written)
+			write_change(tl, tl->time, tl->oio);
+		break;
+	case OIO_BUCKETS:
+		if (!tl->pending) {
+			tl->start = t->time - t->time % tl->res;
+			tl->from = t->time;
+			tl->min = tl->max = i2c->outstanding;
+			break;
+		}
+
+		/* close the buckets that ended before this change */
+		while (t->time >= (end = tl->start + tl->res)) {
+			tl->area += (double)tl->oio * (end - tl->time);
+			write_bucket(tl, end);
 
-	for (i = 0; i < n; i++) {
-		oio[i].time = 0;
-		oio[i].op[READ] = new_hist();
-		oio[i].op[WRITE] = new_hist();
+			tl->start = tl->from = tl->time = end;
+			tl->min = tl->max = tl->oio;
+			tl->area = 0;
+		}
+
+		tl->area += (double)tl->oio * (t->time - tl->time);
+		tl->min = MIN(tl->min, i2c->outstanding);
+		tl->max = MAX(tl->max, i2c->outstanding);
+		break;
 	}
+
+	tl->pending = TRUE;
+	tl->time = t->time;
+	tl->oio = i2c->outstanding;
 }
 
-static gboolean add_to_matrix(__u64 *__unused, struct blk_io_trace *t,
-			      struct i2c_data *i2c)
+static void timeline_close(struct oio_timeline *tl)
 {
-	gsl_histogram_increment(i2c->oio[i2c->outstanding].op[IS_WRITE(t)],
-				(double)(t->bytes / BLK_SIZE));
+	if (!tl->w)
+		return;
+
+	if (tl->pending && tl->mode == OIO_CHANGES && tl->oio != tl->written)
+		write_change(tl, tl->time, tl->oio);
+	else if (tl->pending && tl->mode == OIO_BUCKETS)
+		write_bucket(tl, tl->time);
 
-	return FALSE;
+	writer_close(tl->w);
 }
 
-static void oio_change(struct i2c_data *i2c, struct blk_io_trace *t, int inc)
+static void timeline_init(struct oio_timeline *tl, struct plug_args *pa)
 {
-	/* allocate oio space if the one I had is over */
-	if (i2c->outstanding + 1 >= i2c->oio_size) {
-		i2c->oio = realloc(i2c->oio, (i2c->oio_size + OIO_ALLOC) *
-						     sizeof(struct oio_data));
-		init_oio_data(i2c->oio + i2c->oio_size, OIO_ALLOC);
-		i2c->oio_size += OIO_ALLOC;
+	char filename[FILENAME_MAX];
+
+	memset(tl, 0, sizeof(*tl));
+	tl->written = UINT32_MAX;
+
+	if (pa && pa->i2c_oio_f) {
+		get_filename(filename, "i2c_oio", pa->i2c_oio_f, pa->end_range);
+		tl->w = writer_open(filename);
+		if (!tl->w)
+			perror_exit("Opening I2C detail file");
+
+		tl->mode = pa->i2c_oio_mode;
+		tl->res = pa->i2c_oio_res;
+		tl->bin = pa->binary;
 	}
+}
+
+/* make room for at least @size oio levels, doubling the space */
+static void oio_grow(struct i2c_data *i2c, __u32 size)
+{
+	__u32 new_size = MAX(i2c->oio_size, OIO_ALLOC);
+	__u64 *hist;
+
+	if (size <= i2c->oio_size)
+		return;
+
+	while (new_size < size)
+		new_size *= 2;
+
+	if (posix_memalign((void **)&hist, CACHE_LINE,
+			   (size_t)new_size * ROW_LEN * sizeof(__u64)))
+		error_exit("Allocating I2C OIO histograms\n");
+	if (i2c->oio_hist)
+		memcpy(hist, i2c->oio_hist,
+		       (size_t)i2c->oio_size * ROW_LEN * sizeof(__u64));
+	memset(hist + (size_t)i2c->oio_size * ROW_LEN, 0,
+	       (size_t)(new_size - i2c->oio_size) * ROW_LEN * sizeof(__u64));
+	free(i2c->oio_hist);
+	i2c->oio_hist = hist;
+
+	i2c->oio_time = g_renew(__u64, i2c->oio_time, new_size);
+	memset(i2c->oio_time + i2c->oio_size, 0,
+	       (new_size - i2c->oio_size) * sizeof(__u64));
+
+	i2c->oio_size = new_size;
+}
+
+/* bins are BINS_SEP blocks wide and the last one holds everything
+ * greater than (N_BINS-1)*BINS_SEP */
+static inline unsigned size_bin(const struct blk_io_trace *t)
+{
+	return IS_WRITE(t) * N_BINS +
+	       MIN(t->bytes / BLK_SIZE / BINS_SEP, N_BINS - 1);
+}
+
+static inline void add_row(__u64 *restrict dst, const __u64 *restrict src,
+			   size_t n)
+{
+	size_t i;
+
+	/* plain loop so the compiler vectorizes it */
+	for (i = 0; i < n; i++)
+		dst[i] += src[i];
+}
+
+/* every request in flight is counted in the histogram of the current
+ * oio, which is the same as adding the counts per size bin */
+static void add_to_matrix(struct i2c_data *i2c)
+{
+	add_row(OIO_ROW(i2c, i2c->outstanding), i2c->inflight, ROW_LEN);
+}
+
+static void oio_change(struct i2c_data *i2c, const struct blk_io_trace *t,
+		       int inc, unsigned ioc)
+{
+	unsigned i;
+
+	/* allocate oio space if the one I had is over */
+	oio_grow(i2c, i2c->outstanding + 2);
 
 	/* increase the time */
 	if (i2c->oio_prev_time != UINT64_MAX) {
-		i2c->oio[i2c->outstanding].time += t->time - i2c->oio_prev_time;
+		i2c->oio_time[i2c->outstanding] += t->time - i2c->oio_prev_time;
+		for (i = 0; i < N_IOC; i++)
+			i2c->class_area[i] += (__u64)i2c->class_outs[i] *
+					      (t->time - i2c->oio_prev_time);
 	}
 	i2c->oio_prev_time = t->time;
 
 	if (inc) {
 		i2c->outstanding++;
+		i2c->class_outs[ioc]++;
 	} else {
 		i2c->outstanding--;
+		if (i2c->class_outs[ioc])
+			i2c->class_outs[ioc]--;
 	}
-	i2c->maxouts = MAX(i2c->maxouts, i2c->outstanding);
 
-	g_tree_foreach(i2c->is, (GTraverseFunc)add_to_matrix, i2c);
+	add_to_matrix(i2c);
 
 	write_outs(i2c, t);
 }
 
-static void C(struct blk_io_trace *t, void *data)
+static void insert_i(struct inflight_req *r, void *data)
 {
 	DECL_ASSIGN_I2C(i2c, data);
 
-	if (g_tree_lookup(i2c->is, &t->sector) != NULL) {
-		g_tree_remove(i2c->is, &t->sector);
+	g_tree_insert(i2c->is, &r->t.sector, r);
+	i2c->inflight[size_bin(&r->t)]++;
+}
 
-		oio_change(i2c, t, FALSE);
-	}
+static void remove_i(struct i2c_data *i2c, struct inflight_req *r)
+{
+	i2c->inflight[size_bin(&r->t)]--;
+	g_tree_remove(i2c->is, &r->t.sector);
+	g_free(r);
 }
 
-static void I(struct blk_io_trace *t, void *data)
+static void evict_i(struct inflight_req *r, const struct blk_io_trace *now,
+		    void *data)
 {
 	DECL_ASSIGN_I2C(i2c, data);
+	unsigned ioc = io_class(&r->t);
 
-	if (g_tree_lookup(i2c->is, &t->sector) == NULL) {
-		DECL_DUP(struct blk_io_trace, new_t, t);
-		g_tree_insert(i2c->is, &new_t->sector, new_t);
+	remove_i(i2c, r);
+	oio_change(i2c, now, FALSE, ioc);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+	struct inflight_req *r = g_tree_lookup(i2c->is, &t->sector);
 
-		oio_change(i2c, t, TRUE);
+	unsigned ioc;
+
+	if (r != NULL) {
+		ioc = io_class(&r->t);
+		inflight_del(&i2c->in, r);
+		remove_i(i2c, r);
+
+		oio_change(i2c, t, FALSE, ioc);
 	}
+
+	inflight_expire(&i2c->in, t, evict_i, i2c);
 }
 
-static void add_histogram(gsl_histogram *h1, gsl_histogram *h2)
+static void I(struct blk_io_trace *t, void *data)
 {
-	unsigned int i;
+	DECL_ASSIGN_I2C(i2c, data);
+	unsigned ioc = io_class(t);
 
-	for (i = 0; i < h1->n && i < h2->n; i++) {
-		h1->bin[i] += h2->bin[i];
+	if (g_tree_lookup(i2c->is, &t->sector) == NULL) {
+		insert_i(inflight_add(&i2c->in, t), i2c);
+		oio_change(i2c, t, TRUE, ioc);
+
+		/* counted before the oldest are evicted and taken back out,
+		 * so the max. is the one left */
+		inflight_expire(&i2c->in, t, evict_i, i2c);
+		i2c->maxouts = MAX(i2c->maxouts, i2c->outstanding);
+		i2c->class_max[ioc] =
+			MAX(i2c->class_max[ioc], i2c->class_outs[ioc]);
 	}
 }
 
@@ -149,40 +359,52 @@ void i2c_add(void *data1, const void *data2)
 {
 	DECL_ASSIGN_I2C(i2c1, data1);
 	DECL_ASSIGN_I2C(i2c2, data2);
-	__u32 i;
+	unsigned i;
+	__u32 n;
 
 	i2c1->maxouts = MAX(i2c1->maxouts, i2c2->maxouts);
+	i2c1->in.unmatched += i2c2->in.unmatched;
 	i2c1->oio_prev_time = MAX(i2c1->oio_prev_time, i2c2->oio_prev_time);
 
-	if (i2c1->oio_size < i2c2->oio_size) {
-		__u32 diff = i2c2->oio_size - i2c1->oio_size;
-		i2c1->oio = realloc(i2c1->oio,
-				    i2c2->oio_size * sizeof(struct oio_data));
-		init_oio_data(i2c1->oio + diff, diff);
-		i2c1->oio_size = i2c2->oio_size;
-	}
+	n = MIN(i2c2->maxouts + 1, i2c2->oio_size);
+	oio_grow(i2c1, n);
+
+	add_row(i2c1->oio_time, i2c2->oio_time, n);
+	add_row(i2c1->oio_hist, i2c2->oio_hist, (size_t)n * ROW_LEN);
 
-	for (i = 0; i <= i2c2->maxouts; i++) {
-		i2c1->oio[i].time += i2c2->oio[i].time;
-		add_histogram(i2c1->oio[i].op[READ], i2c2->oio[i].op[READ]);
-		add_histogram(i2c1->oio[i].op[WRITE], i2c2->oio[i].op[WRITE]);
+	for (i = 0; i < N_IOC; i++) {
+		i2c1->class_max[i] = MAX(i2c1->class_max[i], i2c2->class_max[i]);
+		i2c1->class_area[i] += i2c2->class_area[i];
 	}
 }
 
-void i2c_print_results(const void *data)
+static void print_hist(FILE *f, const char *op, __u32 oio, gsl_histogram *h,
+		       const __u64 *bins)
 {
-	DECL_ASSIGN_I2C(i2c, data);
+	unsigned i;
+
+	for (i = 0; i < N_BINS; i++)
+		h->bin[i] = bins[i];
+
+	fprintf(f, "\n%s: %d\n", op, oio);
+	gsl_histogram_fprintf(f, h, "%g", "%g");
+}
+
+/* time-weighted average OIO, printing the histograms of -s if any */
+static double oio_avg(const struct i2c_data *i2c)
+{
+	gsl_histogram *h;
 	double p;
 	double avg = 0;
 	__u32 i;
 	__u64 tot_time = 0;
 
 	for (i = 0; i <= i2c->maxouts; i++) {
-		tot_time += i2c->oio[i].time;
+		tot_time += i2c->oio_time[i];
 	}
 
 	for (i = 0; i <= i2c->maxouts; i++) {
-		p = ((double)i2c->oio[i].time) / ((double)tot_time);
+		p = ((double)i2c->oio_time[i]) / ((double)tot_time);
 
 		if (i2c->oio_hist_f)
 			fprintf(i2c->oio_hist_f, "%u\t%.2lf\n", i, 100 * p);
@@ -192,18 +414,171 @@ void i2c_print_results(const void *data)
 
 	/* print all histograms */
 	if (i2c->oio_hist_f) {
+		h = gsl_histogram_alloc(N_BINS);
+		gsl_histogram_set_ranges_uniform(h, 0, N_BINS * BINS_SEP);
+		h->range[h->n] = DBL_MAX;
+
 		for (i = 1; i <= i2c->maxouts; i++) {
-			fprintf(i2c->oio_hist_f, "\nread: %d\n", i);
-			gsl_histogram_fprintf(i2c->oio_hist_f,
-					      i2c->oio[i].op[READ], "%g", "%g");
-			fprintf(i2c->oio_hist_f, "\nwrite: %d\n", i);
-			gsl_histogram_fprintf(i2c->oio_hist_f,
-					      i2c->oio[i].op[WRITE], "%g",
-					      "%g");
+			print_hist(i2c->oio_hist_f, "read", i, h,
+				   OIO_ROW(i2c, i) + READ * N_BINS);
+			print_hist(i2c->oio_hist_f, "write", i, h,
+				   OIO_ROW(i2c, i) + WRITE * N_BINS);
 		}
+
+		gsl_histogram_free(h);
+	}
+
+	return avg;
+}
+
+/* time covered by the oio levels */
+static __u64 oio_total_time(const struct i2c_data *i2c)
+{
+	__u64 tot_time = 0;
+	__u32 i;
+
+	for (i = 0; i <= i2c->maxouts && i < i2c->oio_size; i++)
+		tot_time += i2c->oio_time[i];
+
+	return tot_time;
+}
+
+static double class_avg(const struct i2c_data *i2c, unsigned ioc)
+{
+	__u64 tot_time = oio_total_time(i2c);
+
+	return tot_time ? (double)i2c->class_area[ioc] / tot_time : 0;
+}
+
+/* a line per class, when there are requests of more than one */
+static void print_classes(const struct i2c_data *i2c)
+{
+	unsigned i, used = 0;
+
+	for (i = 0; i < N_IOC; i++)
+		used += i2c->class_max[i] != 0;
+	if (used < 2)
+		return;
+
+	for (i = 0; i < N_IOC; i++)
+		if (i2c->class_max[i])
+			printf("I2C %s Max. OIO: %u, Avg: %.2lf\n",
+			       io_class_name[i], i2c->class_max[i],
+			       class_avg(i2c, i));
+}
+
+void i2c_print_results(const void *data)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+
+	if (!i2c->oio_size) {
+		printf("I2C Max. OIO: 0\n");
+		goto unmatched;
+	}
+
+	printf("I2C Max. OIO: %u, Avg: %.2lf\n", i2c->maxouts, oio_avg(i2c));
+	print_classes(i2c);
+
+unmatched:
+	if (i2c->in.unmatched)
+		printf("I2C unmatched: %llu (reqs)\n", i2c->in.unmatched);
+}
+
+void i2c_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+	char key[64];
+	unsigned i;
+
+	emit_u64(e, "oio_max", i2c->oio_size ? i2c->maxouts : 0);
+	emit_double(e, "oio_avg", i2c->oio_size ? oio_avg(i2c) : 0);
+	emit_u64(e, "i2c_unmatched", i2c->in.unmatched);
+
+	for (i = 0; i < N_IOC; i++) {
+		emit_class_key(key, sizeof(key), "oio_max", i);
+		emit_u64(e, key, i2c->class_max[i]);
+		emit_class_key(key, sizeof(key), "oio_avg", i);
+		emit_double(e, key, class_avg(i2c, i));
+	}
+}
+
+void i2c_print_row(void *data, __u64 __unused, __u64 end)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+	__u64 tot_time = 0;
+	double avg = 0;
+	__u32 i;
+
+	/* the current oio lasts until the end of the window */
+	if (i2c->oio_prev_time != UINT64_MAX && end > i2c->oio_prev_time) {
+		oio_grow(i2c, i2c->outstanding + 1);
+		i2c->oio_time[i2c->outstanding] += end - i2c->oio_prev_time;
+		i2c->oio_prev_time = end;
 	}
 
-	printf("I2C Max. OIO: %u, Avg: %.2lf\n", i2c->maxouts, avg);
+	for (i = 0; i <= i2c->maxouts && i < i2c->oio_size; i++) {
+		tot_time += i2c->oio_time[i];
+		avg += (double)i * i2c->oio_time[i];
+	}
+
+	printf(" %.2f %u", tot_time ? avg / tot_time : 0, i2c->maxouts);
+}
+
+void i2c_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+
+	ser_put_inflight(f, &i2c->in);
+	SER_PUT(f, i2c->outstanding);
+	SER_PUT(f, i2c->maxouts);
+	SER_PUT(f, i2c->oio_prev_time);
+
+	SER_PUT(f, i2c->oio_size);
+	ser_write(f, i2c->oio_time, i2c->oio_size * sizeof(__u64));
+	ser_write(f, i2c->oio_hist,
+		  (size_t)i2c->oio_size * ROW_LEN * sizeof(__u64));
+
+	SER_PUT(f, i2c->class_outs);
+	SER_PUT(f, i2c->class_max);
+	SER_PUT(f, i2c->class_area);
+}
+
+void i2c_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+	__u32 size;
+
+	ser_get_inflight(f, &i2c->in, insert_i, i2c);
+	SER_GET(f, i2c->outstanding);
+	SER_GET(f, i2c->maxouts);
+	SER_GET(f, i2c->oio_prev_time);
+
+	SER_GET(f, size);
+	oio_grow(i2c, size);
+	ser_read(f, i2c->oio_time, size * sizeof(__u64));
+	ser_read(f, i2c->oio_hist, (size_t)size * ROW_LEN * sizeof(__u64));
+
+	SER_GET(f, i2c->class_outs);
+	SER_GET(f, i2c->class_max);
+	SER_GET(f, i2c->class_area);
+}
+
+void i2c_reset(void *data)
+{
+	DECL_ASSIGN_I2C(i2c, data);
+
+	/* the requests in flight and the time of the last change are
+	 * kept, so the current OIO level keeps being accounted */
+	if (i2c->oio_size) {
+		memset(i2c->oio_time, 0, i2c->oio_size * sizeof(__u64));
+		memset(i2c->oio_hist, 0,
+		       (size_t)i2c->oio_size * ROW_LEN * sizeof(__u64));
+	}
+	i2c->maxouts = i2c->outstanding;
+	i2c->in.unmatched = 0;
+
+	memcpy(i2c->class_max, i2c->class_outs, sizeof(i2c->class_max));
+	memset(i2c->class_area, 0, sizeof(i2c->class_area));
 }
 
 void i2c_init(struct plugin *p, struct plugin_set *__un1, struct plug_args *pa)
@@ -212,19 +587,18 @@ void i2c_init(struct plugin *p, struct plugin_set *__un1, struct plug_args *pa)
 	struct i2c_data *i2c = p->data = g_new(struct i2c_data, 1);
 
 	i2c->is = g_tree_new(comp_int64);
+	inflight_init(&i2c->in, pa);
+	memset(i2c->inflight, 0, sizeof(i2c->inflight));
+	memset(i2c->class_outs, 0, sizeof(i2c->class_outs));
+	memset(i2c->class_max, 0, sizeof(i2c->class_max));
+	memset(i2c->class_area, 0, sizeof(i2c->class_area));
 	i2c->outstanding = 0;
 	i2c->maxouts = 0;
 
-	i2c->oio_f = NULL;
-	if (pa->i2c_oio_f) {
-		get_filename(filename, "i2c_oio", pa->i2c_oio_f, pa->end_range);
-		i2c->oio_f = fopen(filename, "w");
-		if (!i2c->oio_f)
-			perror_exit("Opening I2C detail file");
-	}
+	timeline_init(&i2c->tl, pa);
 
 	i2c->oio_hist_f = NULL;
-	if (pa->i2c_oio_hist_f) {
+	if (pa && pa->i2c_oio_hist_f) {
 		get_filename(filename, "i2c_oio_hist", pa->i2c_oio_hist_f,
 			     pa->end_range);
 		i2c->oio_hist_f = fopen(filename, "w");
@@ -232,7 +606,8 @@ void i2c_init(struct plugin *p, struct plugin_set *__un1, struct plug_args *pa)
 			perror_exit("Opening I2C detail file");
 	}
 
-	i2c->oio = NULL;
+	i2c->oio_time = NULL;
+	i2c->oio_hist = NULL;
 	i2c->oio_size = 0;
 	i2c->oio_prev_time = UINT64_MAX;
 }
@@ -241,6 +616,12 @@ void i2c_ops_init(struct plugin_ops *po)
 {
 	po->add = i2c_add;
 	po->print_results = i2c_print_results;
+	po->emit = i2c_emit;
+	po->save = i2c_save;
+	po->load = i2c_load;
+	po->reset = i2c_reset;
+	po->row_head = "OIO_avg OIO_max";
+	po->print_row = i2c_print_row;
 
 	/* association of event int and function */
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
@@ -249,21 +630,18 @@ void i2c_ops_init(struct plugin_ops *po)
 
 void i2c_destroy(struct plugin *p)
 {
-	unsigned int i;
-
 	DECL_ASSIGN_I2C(i2c, p->data);
 
-	if (i2c->oio_f)
-		fclose(i2c->oio_f);
+	timeline_close(&i2c->tl);
 
 	if (i2c->oio_hist_f)
 		fclose(i2c->oio_hist_f);
 
-	for (i = 0; i <= i2c->maxouts; i++) {
-		gsl_histogram_free(i2c->oio[i].op[READ]);
-		gsl_histogram_free(i2c->oio[i].op[WRITE]);
-	}
-	free(i2c->oio);
+	g_tree_destroy(i2c->is);
+	inflight_destroy(&i2c->in);
+
+	g_free(i2c->oio_time);
+	free(i2c->oio_hist);
 
 	g_free(p->data);
 }
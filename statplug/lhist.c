@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <glib.h>
+
+#include <utils.h>
+#include <serialize.h>
+#include <plugins.h>
+#include <lhist.h>
+#include <emit.h>
+
+void lhist_init(struct lhist *h)
+{
+	h->counts = NULL;
+	lhist_reset(h);
+}
+
+void lhist_destroy(struct lhist *h)
+{
+	g_free(h->counts);
+}
+
+void lhist_reset(struct lhist *h)
+{
+	if (h->counts)
+		memset(h->counts, 0, LHIST_N * sizeof(__u64));
+	h->n = 0;
+	h->sum = 0;
+	h->min = ~0ULL;
+	h->max = 0;
+}
+
+void lhist_add(struct lhist *h1, const struct lhist *h2)
+{
+	unsigned i;
+
+	if (!h2->n)
+		return;
+
+	if (!h1->counts)
+		h1->counts = g_new0(__u64, LHIST_N);
+
+	for (i = 0; i < LHIST_N; i++)
+		h1->counts[i] += h2->counts[i];
+	h1->n += h2->n;
+	h1->sum += h2->sum;
+	h1->min = MIN(h1->min, h2->min);
+	h1->max = MAX(h1->max, h2->max);
+}
+
+static __u64 bucket_high(unsigned i)
+{
+	unsigned e;
+
+	if (i < 2 * LHIST_HALF)
+		return i;
+
+	e = i / LHIST_HALF - 1;
+	return ((i - e * LHIST_HALF + 1) << e) - 1;
+}
+
+__u64 lhist_quantile(const struct lhist *h, double q)
+{
+	__u64 rank, seen = 0;
+	unsigned i;
+
+	if (!h->n)
+		return 0;
+
+	/* smallest value with at least q*n values below or equal */
+	rank = (__u64)(q * h->n);
+	if (rank < q * h->n || !rank)
+		rank++;
+
+	for (i = 0; i < LHIST_N; i++) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			return CLAMP(bucket_high(i), h->min, h->max);
+	}
+
+	return h->max;
+}
+
+__u64 lhist_count_le(const struct lhist *h, __u64 v)
+{
+	__u64 seen = 0;
+	unsigned i, last = lhist_index(v);
+
+	if (!h->n || v < h->min)
+		return 0;
+	if (v >= h->max)
+		return h->n;
+
+	for (i = 0; i <= last; i++)
+		seen += h->counts[i];
+
+	return seen;
+}
+
+void lhist_print(const struct lhist *h, const char *name, double scale,
+		 const char *unit)
+{
+	if (!h->n)
+		return;
+
+	printf("%s p50: %f p90: %f p99: %f p99.9: %f max: %f (%s)\n", name,
+	       lhist_quantile(h, 0.5) / scale, lhist_quantile(h, 0.9) / scale,
+	       lhist_quantile(h, 0.99) / scale,
+	       lhist_quantile(h, 0.999) / scale, h->max / scale, unit);
+}
+
+void lhist_print_classes(const struct lhist *h, const char *name,
+			 double scale, const char *unit)
+{
+	char head[64];
+	unsigned i, used = 0;
+
+	for (i = 0; i < N_IOC; i++)
+		used += h[i].n != 0;
+	if (used < 2)
+		return;
+
+	for (i = 0; i < N_IOC; i++) {
+		snprintf(head, sizeof(head), "%s %s", name, io_class_name[i]);
+		lhist_print(&h[i], head, scale, unit);
+	}
+}
+
+void lhist_emit(const struct lhist *h, struct emitter *e, const char *name,
+		double scale)
+{
+	static const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+	static const char *qnames[] = { "p50", "p90", "p99", "p999" };
+	char key[64];
+	unsigned i;
+
+	for (i = 0; i < G_N_ELEMENTS(qs); i++) {
+		snprintf(key, sizeof(key), "%s_%s", name, qnames[i]);
+		if (scale == 1)
+			emit_u64(e, key, lhist_quantile(h, qs[i]));
+		else
+			emit_double(e, key, lhist_quantile(h, qs[i]) / scale);
+	}
+	snprintf(key, sizeof(key), "%s_max", name);
+	if (scale == 1)
+		emit_u64(e, key, h->max);
+	else
+		emit_double(e, key, h->max / scale);
+}
+
+/* only the buckets in use are saved */
+void lhist_save(const struct lhist *h, FILE *f)
+{
+	__u32 i, used = 0;
+
+	SER_PUT(f, h->n);
+	SER_PUT(f, h->min);
+	SER_PUT(f, h->max);
+	SER_PUT(f, h->sum);
+
+	for (i = 0; h->n && i < LHIST_N; i++)
+		used += h->counts[i] != 0;
+	SER_PUT(f, used);
+
+	for (i = 0; used && i < LHIST_N; i++) {
+		if (h->counts[i]) {
+			SER_PUT(f, i);
+			SER_PUT(f, h->counts[i]);
+		}
+	}
+}
+
+void lhist_load(struct lhist *h, FILE *f)
+{
+	__u32 i, used;
+
+	lhist_reset(h);
+	SER_GET(f, h->n);
+	SER_GET(f, h->min);
+	SER_GET(f, h->max);
+	SER_GET(f, h->sum);
+	SER_GET(f, used);
+
+	if (used && !h->counts)
+		h->counts = g_new0(__u64, LHIST_N);
+
+	while (used--) {
+		SER_GET(f, i);
+		if (i >= LHIST_N)
+			error_exit("Truncated or corrupted state file\n");
+		SER_GET(f, h->counts[i]);
+	}
+}
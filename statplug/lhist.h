@@ -0,0 +1,87 @@
+#ifndef _LHIST_H_
+#define _LHIST_H_
+
+#include <stdio.h>
+#include <glib.h>
+
+#include <blktrace_api.h>
+
+/*
+ * Log-linear histogram of __u64 values (HDR style): values below
+ * 2^LHIST_BITS are counted exactly, and each power of two above has
+ * 2^(LHIST_BITS-1) buckets, so quantiles are within 1/64 of the real
+ * value. Memory is bounded (LHIST_N counters, allocated on the first
+ * value) and two histograms merge exactly.
+ */
+
+#define LHIST_BITS 7
+#define LHIST_HALF (1ULL << (LHIST_BITS - 1))
+#define LHIST_N ((64 - LHIST_BITS + 2) * LHIST_HALF)
+
+struct lhist {
+	__u64 *counts;
+	__u64 n;
+	__u64 min;
+	__u64 max;
+	__u64 sum;
+};
+
+static inline unsigned lhist_index(__u64 v)
+{
+	unsigned e;
+
+	if (v < 2 * LHIST_HALF)
+		return v;
+
+	e = 63 - __builtin_clzll(v) - (LHIST_BITS - 1);
+	return e * LHIST_HALF + (v >> e);
+}
+
+void lhist_init(struct lhist *h);
+void lhist_destroy(struct lhist *h);
+void lhist_reset(struct lhist *h);
+void lhist_add(struct lhist *h1, const struct lhist *h2);
+
+/* @v counted @n times, for the values of a sample with a weight */
+static inline void lhist_record_n(struct lhist *h, __u64 v, __u64 n)
+{
+	if (!h->counts)
+		h->counts = g_new0(__u64, LHIST_N);
+
+	h->counts[lhist_index(v)] += n;
+	h->n += n;
+	h->sum += v * n;
+	h->min = MIN(h->min, v);
+	h->max = MAX(h->max, v);
+}
+
+static inline void lhist_record(struct lhist *h, __u64 v)
+{
+	lhist_record_n(h, v, 1);
+}
+
+/* highest value of the bucket holding the @q quantile */
+__u64 lhist_quantile(const struct lhist *h, double q);
+
+/* values below or equal to @v (with the rest of the bucket of @v) */
+__u64 lhist_count_le(const struct lhist *h, __u64 v);
+
+/* "<name> p50: .. p90: .. p99: .. p99.9: .. max: .. (<unit>)" with the
+ * values divided by @scale, if there is any value */
+void lhist_print(const struct lhist *h, const char *name, double scale,
+		 const char *unit);
+
+/* the same for each class of I/O (see plugins.h), when there are values
+ * of more than one class */
+void lhist_print_classes(const struct lhist *h, const char *name,
+			 double scale, const char *unit);
+
+/* <name>_p50, <name>_p90, <name>_p99, <name>_p999 and <name>_max */
+struct emitter;
+void lhist_emit(const struct lhist *h, struct emitter *e, const char *name,
+		double scale);
+
+void lhist_save(const struct lhist *h, FILE *f);
+void lhist_load(struct lhist *h, FILE *f);
+
+#endif
@@ -0,0 +1,388 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <writer.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_LIFE(name, data) \
+	struct life_data *name = (struct life_data *)data
+
+/*
+ * Lifecycle file, one row per completed request (host byte order): the
+ * magic and version (__u32), blocks of up to LIFE_BLOCK rows and a
+ * footer. A block is its number of rows (__u32) and then each column as
+ * its length in bytes (__u32) followed by its values as LEB128 varints:
+ *
+ *	sector		zigzag delta from the previous row of the block
+ *	blks, op, pid, cpu	op is the class of I/O (see io_class_name)
+ *	q		zigzag delta from the previous row of the block
+ *	g, i, d, c	time since q (ns) plus 1, 0 if the event was not seen
+ *
+ * The footer has the offset and rows (__u64) of each block, the number
+ * of blocks and the magic (__u32), so a mapped file is read from its end
+ * and only the needed columns are decoded.
+ */
+#define LIFE_MAGIC 0x434c5442 /* "BTLC" */
+#define LIFE_VERSION 1
+#define LIFE_BLOCK (1 << 16)
+
+enum {
+	COL_SECTOR,
+	COL_BLKS,
+	COL_OP,
+	COL_PID,
+	COL_CPU,
+	COL_Q,
+	COL_G,
+	COL_I,
+	COL_D,
+	COL_C,
+	N_COLS
+};
+
+/* request followed from its Q, indexed by sector */
+struct life_req {
+	struct inflight_req r;
+	__u64 g;
+	__u64 i;
+	__u64 d;
+};
+
+struct life_col {
+	__u8 *buf;
+	__u32 len;
+};
+
+struct life_block {
+	__u64 off;
+	__u64 rows;
+};
+
+struct life_data {
+	GTree *reqs;
+	GPtrArray *done;
+	struct inflight in;
+	const struct plugin_set *ps;
+
+	/* block being encoded and blocks written */
+	struct writer *w;
+	struct life_col cols[N_COLS];
+	__u32 rows;
+	__u64 prev_sector;
+	__u64 prev_q;
+	__u64 off;
+	GArray *index;
+
+	__u64 exported;
+};
+
+static inline void put_varint(struct life_col *c, __u64 v)
+{
+	while (v >= 0x80) {
+		c->buf[c->len++] = v | 0x80;
+		v >>= 7;
+	}
+	c->buf[c->len++] = v;
+}
+
+/* zigzag, so small negative deltas are small too */
+static inline void put_delta(struct life_col *c, __u64 v, __u64 prev)
+{
+	__u64 d = v - prev;
+
+	put_varint(c, (d << 1) ^ -(d >> 63));
+}
+
+static inline void put_since(struct life_col *c, __u64 t, __u64 q)
+{
+	put_varint(c, t >= q ? t - q + 1 : 0);
+}
+
+static void life_write(struct life_data *life, const void *buf, size_t len)
+{
+	writer_write(life->w, buf, len);
+	life->off += len;
+}
+
+static void flush_block(struct life_data *life)
+{
+	struct life_block b = { life->off, life->rows };
+	unsigned i;
+
+	if (!life->rows)
+		return;
+
+	life_write(life, &life->rows, sizeof(life->rows));
+	for (i = 0; i < N_COLS; i++) {
+		life_write(life, &life->cols[i].len, sizeof(__u32));
+		life_write(life, life->cols[i].buf, life->cols[i].len);
+		life->cols[i].len = 0;
+	}
+	g_array_append_val(life->index, b);
+
+	life->rows = 0;
+	life->prev_sector = life->prev_q = 0;
+}
+
+static void add_row(struct life_data *life, const struct life_req *lr,
+		    const struct blk_io_trace *c)
+{
+	const struct blk_io_trace *q = &lr->r.t;
+
+	put_delta(&life->cols[COL_SECTOR], c->sector, life->prev_sector);
+	put_varint(&life->cols[COL_BLKS], t_blks(c));
+	put_varint(&life->cols[COL_OP], life->ps->ioc);
+	put_varint(&life->cols[COL_PID], q->pid);
+	put_varint(&life->cols[COL_CPU], q->cpu);
+	put_delta(&life->cols[COL_Q], q->time, life->prev_q);
+	put_since(&life->cols[COL_G], lr->g, q->time);
+	put_since(&life->cols[COL_I], lr->i, q->time);
+	put_since(&life->cols[COL_D], lr->d, q->time);
+	put_since(&life->cols[COL_C], c->time, q->time);
+
+	life->prev_sector = c->sector;
+	life->prev_q = q->time;
+	life->exported++;
+
+	if (++life->rows == LIFE_BLOCK)
+		flush_block(life);
+}
+
+static void insert_l(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_LIFE(life, data);
+
+	g_tree_insert(life->reqs, &r->t.sector, r);
+}
+
+static void evict_l(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_LIFE(life, data);
+
+	g_tree_remove(life->reqs, &r->t.sector);
+	g_free(r);
+}
+
+static void Q(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_LIFE(life, data);
+
+	if (!life->w || !t_blks(t) ||
+	    g_tree_lookup(life->reqs, &t->sector))
+		return;
+
+	insert_l(__inflight_add(&life->in, t, sizeof(struct life_req)), life);
+	inflight_expire(&life->in, t, evict_l, life);
+}
+
+/* G, I and D of the request starting at the sector of the event */
+static struct life_req *lookup_l(struct life_data *life,
+				 const struct blk_io_trace *t)
+{
+	return life->w ? g_tree_lookup(life->reqs, &t->sector) : NULL;
+}
+
+static void G(struct blk_io_trace *t, void *data)
+{
+	struct life_req *lr = lookup_l(data, t);
+
+	if (lr && !lr->g)
+		lr->g = t->time;
+}
+
+static void I(struct blk_io_trace *t, void *data)
+{
+	struct life_req *lr = lookup_l(data, t);
+
+	if (lr && !lr->i)
+		lr->i = t->time;
+}
+
+static void D(struct blk_io_trace *t, void *data)
+{
+	struct life_req *lr = lookup_l(data, t);
+
+	if (lr && !lr->d)
+		lr->d = t->time;
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_LIFE(life, data);
+	__u64 first = BIT_START(t);
+	guint i;
+
+	if (!life->w || !t_blks(t))
+		return;
+
+	/* the request is the one queued at the sector of the completion;
+	 * the other bios covered were merged into it */
+	inflight_covered(life->reqs, &first, t, life->done);
+
+	for (i = 0; i < life->done->len; i++) {
+		struct life_req *lr = g_ptr_array_index(life->done, i);
+
+		if (lr->r.t.sector == t->sector)
+			add_row(life, lr, t);
+
+		g_tree_remove(life->reqs, &lr->r.t.sector);
+		inflight_del(&life->in, &lr->r);
+		g_free(lr);
+	}
+	g_ptr_array_set_size(life->done, 0);
+
+	inflight_expire(&life->in, t, evict_l, life);
+}
+
+void lifecycle_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_LIFE(life1, data1);
+	DECL_ASSIGN_LIFE(life2, data2);
+
+	life1->exported += life2->exported;
+	life1->in.unmatched += life2->in.unmatched;
+}
+
+void lifecycle_print_results(const void *data)
+{
+	DECL_ASSIGN_LIFE(life, data);
+
+	if (life->exported)
+		printf("Lifecycle rows: %llu\n", life->exported);
+}
+
+void lifecycle_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_LIFE(life, data);
+
+	emit_u64(e, "lifecycle_rows", life->exported);
+}
+
+void lifecycle_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_LIFE(life, data);
+	__u32 n = life->in.q.length;
+	GList *l;
+
+	/* the requests with their G, I and D so far */
+	SER_PUT(f, n);
+	for (l = life->in.q.head; l; l = l->next) {
+		const struct life_req *lr = l->data;
+
+		SER_PUT(f, lr->r.t);
+		SER_PUT(f, lr->g);
+		SER_PUT(f, lr->i);
+		SER_PUT(f, lr->d);
+	}
+	SER_PUT(f, life->in.unmatched);
+	SER_PUT(f, life->exported);
+}
+
+void lifecycle_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_LIFE(life, data);
+	struct blk_io_trace t;
+	struct life_req *lr;
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		lr = (struct life_req *)__inflight_add(&life->in, &t,
+						       sizeof(*lr));
+		SER_GET(f, lr->g);
+		SER_GET(f, lr->i);
+		SER_GET(f, lr->d);
+		insert_l(&lr->r, life);
+	}
+	SER_GET(f, life->in.unmatched);
+	SER_GET(f, life->exported);
+}
+
+void lifecycle_reset(void *data)
+{
+	DECL_ASSIGN_LIFE(life, data);
+
+	life->exported = 0;
+	life->in.unmatched = 0;
+}
+
+void lifecycle_init(struct plugin *p, struct plugin_set *ps,
+		    struct plug_args *pa)
+{
+	__u32 hdr[2] = { LIFE_MAGIC, LIFE_VERSION };
+	char filename[FILENAME_MAX];
+	unsigned i;
+	struct life_data *life = p->data = g_new0(struct life_data, 1);
+
+	life->reqs = g_tree_new(comp_int64);
+	life->done = g_ptr_array_new();
+	inflight_init(&life->in, pa);
+	life->ps = ps;
+
+	/* nothing is followed without a file */
+	if (pa && pa->lifecycle_f) {
+		get_filename(filename, "lifecycle", pa->lifecycle_f,
+			     pa->end_range);
+		life->w = writer_open(filename);
+		if (!life->w)
+			perror_exit("Opening lifecycle file");
+
+		for (i = 0; i < N_COLS; i++)
+			life->cols[i].buf = g_malloc(LIFE_BLOCK * 10);
+		life->index = g_array_new(FALSE, FALSE,
+					  sizeof(struct life_block));
+		life_write(life, hdr, sizeof(hdr));
+	}
+}
+
+void lifecycle_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_LIFE(life, p->data);
+	__u32 n, magic = LIFE_MAGIC;
+	unsigned i;
+
+	if (life->w) {
+		flush_block(life);
+		n = life->index->len;
+		life_write(life, life->index->data,
+			   n * sizeof(struct life_block));
+		life_write(life, &n, sizeof(n));
+		life_write(life, &magic, sizeof(magic));
+		writer_close(life->w);
+
+		for (i = 0; i < N_COLS; i++)
+			g_free(life->cols[i].buf);
+		g_array_free(life->index, TRUE);
+	}
+
+	g_tree_destroy(life->reqs);
+	inflight_destroy(&life->in);
+	g_ptr_array_free(life->done, TRUE);
+	g_free(p->data);
+}
+
+void lifecycle_ops_init(struct plugin_ops *po)
+{
+	po->add = lifecycle_add;
+	po->print_results = lifecycle_print_results;
+	po->emit = lifecycle_emit;
+	po->save = lifecycle_save;
+	po->load = lifecycle_load;
+	po->reset = lifecycle_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_QUEUE, Q);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_GETRQ, G);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_INSERT, I);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
@@ -18,6 +18,16 @@ DECLARE_PLUG_FUNCS(i2c);
 DECLARE_PLUG_FUNCS(c2d);
 DECLARE_PLUG_FUNCS(merge);
 DECLARE_PLUG_FUNCS(pluging);
+DECLARE_PLUG_FUNCS(lifecycle);
+DECLARE_PLUG_FUNCS(phases);
+DECLARE_PLUG_FUNCS(pids);
+DECLARE_PLUG_FUNCS(heat);
+DECLARE_PLUG_FUNCS(wss);
+DECLARE_PLUG_FUNCS(mrc);
+DECLARE_PLUG_FUNCS(streams);
+DECLARE_PLUG_FUNCS(cpus);
+DECLARE_PLUG_FUNCS(qd);
+DECLARE_PLUG_FUNCS(flush);
 
 /* list of initilizers and destroyers for each function */
 enum {
@@ -29,6 +39,16 @@ enum {
 	I2C_IND,
 	MERGE_IND,
 	PLUGING_IND,
+	LIFECYCLE_IND,
+	PHASES_IND,
+	PIDS_IND,
+	HEAT_IND,
+	WSS_IND,
+	MRC_IND,
+	STREAMS_IND,
+	CPUS_IND,
+	QD_IND,
+	FLUSH_IND,
 	N_PLUGINS
 };
 static const struct plug_init_dest_funcs plug_init_dest[] = {
@@ -63,6 +83,46 @@ static const struct plug_init_dest_funcs plug_init_dest[] = {
 	{ .init = pluging_init,
 	  .destroy = pluging_destroy,
 	  .ops_init = pluging_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = lifecycle_init,
+	  .destroy = lifecycle_destroy,
+	  .ops_init = lifecycle_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = phases_init,
+	  .destroy = phases_destroy,
+	  .ops_init = phases_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = pids_init,
+	  .destroy = pids_destroy,
+	  .ops_init = pids_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = heat_init,
+	  .destroy = heat_destroy,
+	  .ops_init = heat_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = wss_init,
+	  .destroy = wss_destroy,
+	  .ops_init = wss_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = mrc_init,
+	  .destroy = mrc_destroy,
+	  .ops_init = mrc_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = streams_init,
+	  .destroy = streams_destroy,
+	  .ops_init = streams_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = cpus_init,
+	  .destroy = cpus_destroy,
+	  .ops_init = cpus_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = qd_init,
+	  .destroy = qd_destroy,
+	  .ops_init = qd_ops_init,
+	  .ops_destroy = NULL },
+	{ .init = flush_init,
+	  .destroy = flush_destroy,
+	  .ops_init = flush_ops_init,
 	  .ops_destroy = NULL }
 };
 
@@ -3,6 +3,8 @@
 
 #include <plugins.h>
 #include <blktrace_api.h>
+#include <serialize.h>
+#include <emit.h>
 
 #define DECL_ASSIGN_MERGE(name, data) \
 	struct merge_data *name = (struct merge_data *)data
@@ -58,6 +60,33 @@ void merge_print_results(const void *data)
 		printf("#I: 0\n");
 }
 
+void merge_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_MERGE(m, data);
+
+	emit_u64(e, "inserts", m->ins);
+	emit_u64(e, "merges", m->fs + m->ms);
+	emit_double(e, "merge_ratio",
+		    m->ins ? ((double)m->fs + m->ms + m->ins) / m->ins : 0);
+}
+
+void merge_save(const void *data, FILE *f)
+{
+	ser_write(f, data, sizeof(struct merge_data));
+}
+
+void merge_load(void *data, FILE *f)
+{
+	ser_read(f, data, sizeof(struct merge_data));
+}
+
+void merge_reset(void *data)
+{
+	DECL_ASSIGN_MERGE(m, data);
+
+	m->ms = m->fs = m->ins = 0;
+}
+
 void merge_init(struct plugin *p, struct plugin_set *__un1,
 		struct plug_args *__un2)
 {
@@ -69,6 +98,10 @@ void merge_ops_init(struct plugin_ops *po)
 {
 	po->add = merge_add;
 	po->print_results = merge_print_results;
+	po->emit = merge_emit;
+	po->save = merge_save;
+	po->load = merge_load;
+	po->reset = merge_reset;
 
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_BACKMERGE, M);
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_FRONTMERGE, F);
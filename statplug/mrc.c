@@ -0,0 +1,345 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <slab.h>
+#include <lhist.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_MRC(name, data) \
+	struct mrc_data *name = (struct mrc_data *)data
+
+/*
+ * Miss ratio curve of an LRU cache of 4KiB blocks with SHARDS: only the
+ * blocks whose hash is below a threshold are simulated, and the threshold
+ * is lowered (dropping the blocks above) to keep at most MRC_SAMPLES of
+ * them. The reuse distance of a sampled block is the number of sampled
+ * blocks accessed since its last access, counted in a Fenwick tree over
+ * the access times, and it is scaled by the sampling rate. Each access
+ * counts as many as the ones it stands for (1/rate, in 1/256 units) so
+ * the ones sampled before the threshold is lowered do not weigh more.
+ */
+#define MRC_SAMPLES 8192
+#define MRC_HASH_BITS 24
+#define MRC_CLOCK (4 * MRC_SAMPLES)
+#define MRC_BLK_SHIFT 3
+
+enum { MRC_READ, MRC_WRITE, N_MRC };
+
+static const char *mrc_name[N_MRC] = { "read", "write" };
+
+/* cache sizes of the curve, in 4KiB blocks */
+#define MRC_SIZES 8
+static const char *mrc_size_name[MRC_SIZES] = { "16M", "64M",  "256M",
+						"1G",  "4G",   "16G",
+						"64G", "256G" };
+#define MRC_SIZE(i) (1ULL << (12 + 2 * (i)))
+
+struct mrc_block {
+	__u64 h;
+	__u32 time;
+};
+
+struct mrc_data {
+	/* sampled blocks by hash, and the last access of each in fen */
+	GTree *blocks;
+	struct slab slab;
+	__u32 thr;
+	__u32 clock;
+	__u32 fen[MRC_CLOCK + 1];
+
+	/* cache size (4KiB blks) needed for each hit, and the cold misses,
+	 * weighted */
+	struct lhist dist[N_MRC];
+	__u64 cold[N_MRC];
+};
+
+static void fen_add(struct mrc_data *mrc, __u32 time, int v)
+{
+	__u32 i;
+
+	for (i = time + 1; i <= MRC_CLOCK; i += i & -i)
+		mrc->fen[i] += v;
+}
+
+/* blocks accessed last at @time or before */
+static __u32 fen_sum(const struct mrc_data *mrc, __u32 time)
+{
+	__u32 i, sum = 0;
+
+	for (i = time + 1; i; i -= i & -i)
+		sum += mrc->fen[i];
+
+	return sum;
+}
+
+static gboolean collect(gpointer __unused, gpointer b, gpointer arr)
+{
+	g_ptr_array_add(arr, b);
+	return FALSE;
+}
+
+static int comp_time(const void *a, const void *b)
+{
+	const struct mrc_block *x = *(const struct mrc_block **)a;
+	const struct mrc_block *y = *(const struct mrc_block **)b;
+
+	return x->time > y->time ? 1 : (x->time < y->time ? -1 : 0);
+}
+
+/* renumber the access times from 0 once the clock is exhausted */
+static void compact(struct mrc_data *mrc)
+{
+	GPtrArray *arr = g_ptr_array_new();
+	struct mrc_block *b;
+	guint i;
+
+	g_tree_foreach(mrc->blocks, collect, arr);
+	qsort(arr->pdata, arr->len, sizeof(gpointer), comp_time);
+
+	memset(mrc->fen, 0, sizeof(mrc->fen));
+	for (i = 0; i < arr->len; i++) {
+		b = g_ptr_array_index(arr, i);
+		b->time = i;
+		fen_add(mrc, i, 1);
+	}
+	mrc->clock = arr->len;
+
+	g_ptr_array_free(arr, TRUE);
+}
+
+static void drop(struct mrc_data *mrc, struct mrc_block *b)
+{
+	fen_add(mrc, b->time, -1);
+	g_tree_remove(mrc->blocks, &b->h);
+	slab_free(&mrc->slab, b);
+}
+
+/* lower the threshold to the highest hash sampled and drop its blocks */
+static void shrink(struct mrc_data *mrc)
+{
+	struct mrc_block *b;
+	GTreeNode *n;
+
+	n = g_tree_node_last(mrc->blocks);
+	mrc->thr = ((struct mrc_block *)g_tree_node_value(n))->h >>
+		   (64 - MRC_HASH_BITS);
+
+	while ((n = g_tree_node_last(mrc->blocks))) {
+		b = g_tree_node_value(n);
+		if ((b->h >> (64 - MRC_HASH_BITS)) < mrc->thr)
+			break;
+		drop(mrc, b);
+	}
+}
+
+static void access_block(struct mrc_data *mrc, __u64 h, unsigned op)
+{
+	__u64 w = (1ULL << (MRC_HASH_BITS + 8)) / mrc->thr;
+	struct mrc_block *b;
+	__u64 d;
+
+	if ((h >> (64 - MRC_HASH_BITS)) >= mrc->thr)
+		return;
+
+	if (mrc->clock == MRC_CLOCK)
+		compact(mrc);
+
+	b = g_tree_lookup(mrc->blocks, &h);
+	if (b) {
+		/* a hit with more sampled blocks than the ones seen since */
+		d = g_tree_nnodes(mrc->blocks) - fen_sum(mrc, b->time) + 1;
+		lhist_record_n(&mrc->dist[op], (d << MRC_HASH_BITS) / mrc->thr,
+			       w);
+		fen_add(mrc, b->time, -1);
+	} else {
+		mrc->cold[op] += w;
+		b = slab_alloc(&mrc->slab);
+		b->h = h;
+		g_tree_insert(mrc->blocks, &b->h, b);
+	}
+
+	b->time = mrc->clock++;
+	fen_add(mrc, b->time, 1);
+
+	if (g_tree_nnodes(mrc->blocks) > MRC_SAMPLES)
+		shrink(mrc);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_MRC(mrc, data);
+	__u64 blks = t_blks(t), dev, b, last;
+	unsigned op;
+
+	if (!blks)
+		return;
+
+	op = IS_WRITE(t) ? MRC_WRITE : MRC_READ;
+	dev = mix(t->device);
+	last = (t->sector + blks - 1) >> MRC_BLK_SHIFT;
+	for (b = t->sector >> MRC_BLK_SHIFT; b <= last; b++)
+		access_block(mrc, mix(b ^ dev), op);
+}
+
+void mrc_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_MRC(mrc1, data1);
+	DECL_ASSIGN_MRC(mrc2, data2);
+	unsigned i;
+
+	for (i = 0; i < N_MRC; i++) {
+		lhist_add(&mrc1->dist[i], &mrc2->dist[i]);
+		mrc1->cold[i] += mrc2->cold[i];
+	}
+}
+
+static double hit_ratio(const struct mrc_data *mrc, unsigned op, unsigned i)
+{
+	__u64 total = mrc->dist[op].n + mrc->cold[op];
+
+	return total ? (double)lhist_count_le(&mrc->dist[op], MRC_SIZE(i)) /
+			       total :
+		       0;
+}
+
+void mrc_print_results(const void *data)
+{
+	DECL_ASSIGN_MRC(mrc, data);
+	unsigned op, i;
+
+	for (op = 0; op < N_MRC; op++) {
+		if (!mrc->dist[op].n && !mrc->cold[op])
+			continue;
+
+		printf("LRU hit ratio %s:", mrc_name[op]);
+		for (i = 0; i < MRC_SIZES; i++)
+			printf(" %s: %.1f%%", mrc_size_name[i],
+			       100 * hit_ratio(mrc, op, i));
+		printf("\n");
+	}
+}
+
+void mrc_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_MRC(mrc, data);
+	char key[64];
+	unsigned op, i;
+
+	for (op = 0; op < N_MRC; op++) {
+		for (i = 0; i < MRC_SIZES; i++) {
+			snprintf(key, sizeof(key), "lru_%s_hit_%s",
+				 mrc_name[op], mrc_size_name[i]);
+			emit_double(e, key, hit_ratio(mrc, op, i));
+		}
+	}
+}
+
+void mrc_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_MRC(mrc, data);
+	GPtrArray *arr = g_ptr_array_new();
+	const struct mrc_block *b;
+	__u32 n;
+	guint i;
+
+	g_tree_foreach(mrc->blocks, collect, arr);
+	n = arr->len;
+	SER_PUT(f, mrc->thr);
+	SER_PUT(f, mrc->clock);
+	SER_PUT(f, n);
+	for (i = 0; i < arr->len; i++) {
+		b = g_ptr_array_index(arr, i);
+		SER_PUT(f, b->h);
+		SER_PUT(f, b->time);
+	}
+	g_ptr_array_free(arr, TRUE);
+
+	for (i = 0; i < N_MRC; i++)
+		lhist_save(&mrc->dist[i], f);
+	SER_PUT(f, mrc->cold);
+}
+
+void mrc_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_MRC(mrc, data);
+	struct mrc_block *b;
+	__u32 n;
+	unsigned i;
+
+	SER_GET(f, mrc->thr);
+	SER_GET(f, mrc->clock);
+	SER_GET(f, n);
+	if (n > MRC_SAMPLES || mrc->clock > MRC_CLOCK)
+		error_exit("Truncated or corrupted state file\n");
+	while (n--) {
+		b = slab_alloc(&mrc->slab);
+		SER_GET(f, b->h);
+		SER_GET(f, b->time);
+		if (b->time >= mrc->clock)
+			error_exit("Truncated or corrupted state file\n");
+		g_tree_insert(mrc->blocks, &b->h, b);
+		fen_add(mrc, b->time, 1);
+	}
+
+	for (i = 0; i < N_MRC; i++)
+		lhist_load(&mrc->dist[i], f);
+	SER_GET(f, mrc->cold);
+}
+
+void mrc_reset(void *data)
+{
+	DECL_ASSIGN_MRC(mrc, data);
+	unsigned i;
+
+	/* the content of the cache is kept */
+	for (i = 0; i < N_MRC; i++) {
+		lhist_reset(&mrc->dist[i]);
+		mrc->cold[i] = 0;
+	}
+}
+
+void mrc_init(struct plugin *p, struct plugin_set *__unused,
+	      struct plug_args *__un2)
+{
+	struct mrc_data *mrc = p->data = g_new0(struct mrc_data, 1);
+	unsigned i;
+
+	mrc->blocks = g_tree_new(comp_int64);
+	slab_init(&mrc->slab, sizeof(struct mrc_block));
+	mrc->thr = 1 << MRC_HASH_BITS;
+	for (i = 0; i < N_MRC; i++)
+		lhist_init(&mrc->dist[i]);
+}
+
+void mrc_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_MRC(mrc, p->data);
+	unsigned i;
+
+	/* the blocks are freed with the slab */
+	g_tree_destroy(mrc->blocks);
+	slab_destroy(&mrc->slab);
+	for (i = 0; i < N_MRC; i++)
+		lhist_destroy(&mrc->dist[i]);
+	g_free(p->data);
+}
+
+void mrc_ops_init(struct plugin_ops *po)
+{
+	po->add = mrc_add;
+	po->print_results = mrc_print_results;
+	po->emit = mrc_emit;
+	po->save = mrc_save;
+	po->load = mrc_load;
+	po->reset = mrc_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
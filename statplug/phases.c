@@ -0,0 +1,352 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <slab.h>
+#include <lhist.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_PHASES(name, data) \
+	struct phases_data *name = (struct phases_data *)data
+
+/* phases of a request */
+enum { PH_Q2G, PH_SLEEP, PH_G2I, PH_I2D, PH_D2C, N_PHASES };
+
+static const char *phase_name[N_PHASES] = {
+	[PH_Q2G] = "Q2G", [PH_SLEEP] = "Sleep", [PH_G2I] = "G2I",
+	[PH_I2D] = "I2D", [PH_D2C] = "Phase D2C",
+};
+
+static const char *phase_key[N_PHASES] = {
+	[PH_Q2G] = "q2g_msec", [PH_SLEEP] = "sleep_msec",
+	[PH_G2I] = "g2i_msec", [PH_I2D] = "i2d_msec",
+	[PH_D2C] = "phase_d2c_msec",
+};
+
+/* request followed from its Q, indexed by sector. S is the first time
+ * it slept waiting for a request (tag) */
+struct phase_req {
+	struct inflight_req r;
+	__u64 s;
+	__u64 g;
+	__u64 i;
+	__u64 d;
+};
+
+struct phases_data {
+	GTree *reqs;
+	GPtrArray *done;
+	struct inflight in;
+	struct slab slab;
+
+	/* time of each phase of the completed requests */
+	struct lhist phases[N_PHASES];
+
+	/* bios queued, sleeps waiting for a request, splits and bounces */
+	__u64 queued;
+	__u64 sleeps;
+	__u64 splits;
+	__u64 bounces;
+};
+
+static void insert_p(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+
+	g_tree_insert(ph->reqs, &r->t.sector, r);
+}
+
+static void evict_p(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+
+	g_tree_remove(ph->reqs, &r->t.sector);
+	slab_free(&ph->slab, r);
+}
+
+static void Q(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	struct phase_req *pr;
+
+	if (!t_blks(t) || g_tree_lookup(ph->reqs, &t->sector))
+		return;
+
+	pr = slab_alloc(&ph->slab);
+	inflight_insert(&ph->in, &pr->r, t);
+	insert_p(&pr->r, ph);
+	ph->queued++;
+
+	inflight_expire(&ph->in, t, evict_p, ph);
+}
+
+static void S(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	struct phase_req *pr = g_tree_lookup(ph->reqs, &t->sector);
+
+	ph->sleeps++;
+	if (pr && !pr->s)
+		pr->s = t->time;
+}
+
+static void G(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	struct phase_req *pr = g_tree_lookup(ph->reqs, &t->sector);
+
+	if (pr && !pr->g)
+		pr->g = t->time;
+}
+
+static void I(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	struct phase_req *pr = g_tree_lookup(ph->reqs, &t->sector);
+
+	if (pr && !pr->i)
+		pr->i = t->time;
+}
+
+static void D(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	struct phase_req *pr = g_tree_lookup(ph->reqs, &t->sector);
+
+	if (pr && !pr->d)
+		pr->d = t->time;
+}
+
+static void X(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+
+	ph->splits++;
+}
+
+static void B(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+
+	ph->bounces++;
+}
+
+static void record(struct lhist *h, gboolean seen, __u64 from, __u64 to)
+{
+	if (seen && to >= from)
+		lhist_record(h, to - from);
+}
+
+static void account(struct phases_data *ph, const struct phase_req *pr,
+		    const struct blk_io_trace *c)
+{
+	record(&ph->phases[PH_Q2G], pr->g, pr->r.t.time, pr->g);
+	record(&ph->phases[PH_SLEEP], pr->s && pr->g, pr->s, pr->g);
+	record(&ph->phases[PH_G2I], pr->g && pr->i, pr->g, pr->i);
+	record(&ph->phases[PH_I2D], pr->i && pr->d, pr->i, pr->d);
+	record(&ph->phases[PH_D2C], pr->d, pr->d, c->time);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	__u64 first = BIT_START(t);
+	struct phase_req *pr;
+	guint i;
+
+	if (!t_blks(t))
+		return;
+
+	/* the request queued at the sector of the completion (only its
+	 * first part if it was split) and the bios merged into it */
+	inflight_covered(ph->reqs, &first, t, ph->done);
+	pr = g_tree_lookup(ph->reqs, &t->sector);
+	if (pr) {
+		account(ph, pr, t);
+		/* not covered if only its first part completed */
+		if (t_blks(&pr->r.t) > t_blks(t))
+			g_ptr_array_add(ph->done, pr);
+	}
+
+	for (i = 0; i < ph->done->len; i++) {
+		pr = g_ptr_array_index(ph->done, i);
+
+		g_tree_remove(ph->reqs, &pr->r.t.sector);
+		inflight_del(&ph->in, &pr->r);
+		slab_free(&ph->slab, pr);
+	}
+	g_ptr_array_set_size(ph->done, 0);
+
+	inflight_expire(&ph->in, t, evict_p, ph);
+}
+
+void phases_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_PHASES(ph1, data1);
+	DECL_ASSIGN_PHASES(ph2, data2);
+	unsigned i;
+
+	for (i = 0; i < N_PHASES; i++)
+		lhist_add(&ph1->phases[i], &ph2->phases[i]);
+	ph1->queued += ph2->queued;
+	ph1->sleeps += ph2->sleeps;
+	ph1->splits += ph2->splits;
+	ph1->bounces += ph2->bounces;
+	ph1->in.unmatched += ph2->in.unmatched;
+}
+
+/* bios reaching the driver per bio queued */
+static double split_amp(const struct phases_data *ph)
+{
+	return ph->queued ? ((double)ph->queued + ph->splits) / ph->queued : 0;
+}
+
+void phases_print_results(const void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	unsigned i;
+
+	for (i = 0; i < N_PHASES; i++)
+		lhist_print(&ph->phases[i], phase_name[i], 1e6, "msec");
+
+	if (ph->sleeps || ph->splits || ph->bounces)
+		printf("Sleeps #: %llu Splits #: %llu (amp.: %f) Bounces #: %llu\n",
+		       ph->sleeps, ph->splits, split_amp(ph), ph->bounces);
+}
+
+void phases_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	unsigned i;
+
+	for (i = 0; i < N_PHASES; i++)
+		lhist_emit(&ph->phases[i], e, phase_key[i], 1e6);
+
+	emit_u64(e, "sleeps", ph->sleeps);
+	emit_u64(e, "splits", ph->splits);
+	emit_double(e, "split_amp", split_amp(ph));
+	emit_u64(e, "bounces", ph->bounces);
+}
+
+void phases_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	__u32 n = ph->in.q.length;
+	unsigned i;
+	GList *l;
+
+	/* the requests with their S, G, I and D so far */
+	SER_PUT(f, n);
+	for (l = ph->in.q.head; l; l = l->next) {
+		const struct phase_req *pr = l->data;
+
+		SER_PUT(f, pr->r.t);
+		SER_PUT(f, pr->s);
+		SER_PUT(f, pr->g);
+		SER_PUT(f, pr->i);
+		SER_PUT(f, pr->d);
+	}
+	SER_PUT(f, ph->in.unmatched);
+
+	for (i = 0; i < N_PHASES; i++)
+		lhist_save(&ph->phases[i], f);
+	SER_PUT(f, ph->queued);
+	SER_PUT(f, ph->sleeps);
+	SER_PUT(f, ph->splits);
+	SER_PUT(f, ph->bounces);
+}
+
+void phases_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	struct blk_io_trace t;
+	struct phase_req *pr;
+	unsigned i;
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		pr = slab_alloc(&ph->slab);
+		inflight_insert(&ph->in, &pr->r, &t);
+		SER_GET(f, pr->s);
+		SER_GET(f, pr->g);
+		SER_GET(f, pr->i);
+		SER_GET(f, pr->d);
+		insert_p(&pr->r, ph);
+	}
+	SER_GET(f, ph->in.unmatched);
+
+	for (i = 0; i < N_PHASES; i++)
+		lhist_load(&ph->phases[i], f);
+	SER_GET(f, ph->queued);
+	SER_GET(f, ph->sleeps);
+	SER_GET(f, ph->splits);
+	SER_GET(f, ph->bounces);
+}
+
+void phases_reset(void *data)
+{
+	DECL_ASSIGN_PHASES(ph, data);
+	unsigned i;
+
+	for (i = 0; i < N_PHASES; i++)
+		lhist_reset(&ph->phases[i]);
+	ph->queued = ph->sleeps = ph->splits = ph->bounces = 0;
+	ph->in.unmatched = 0;
+}
+
+void phases_init(struct plugin *p, struct plugin_set *__unused,
+		 struct plug_args *pa)
+{
+	unsigned i;
+	struct phases_data *ph = p->data = g_new0(struct phases_data, 1);
+
+	ph->reqs = g_tree_new(comp_int64);
+	ph->done = g_ptr_array_new();
+	inflight_init(&ph->in, pa);
+	slab_init(&ph->slab, sizeof(struct phase_req));
+	for (i = 0; i < N_PHASES; i++)
+		lhist_init(&ph->phases[i]);
+}
+
+void phases_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_PHASES(ph, p->data);
+	unsigned i;
+
+	/* the requests are freed with the slab */
+	g_tree_destroy(ph->reqs);
+	g_ptr_array_free(ph->done, TRUE);
+	slab_destroy(&ph->slab);
+	for (i = 0; i < N_PHASES; i++)
+		lhist_destroy(&ph->phases[i]);
+	g_free(p->data);
+}
+
+void phases_ops_init(struct plugin_ops *po)
+{
+	po->add = phases_add;
+	po->print_results = phases_print_results;
+	po->emit = phases_emit;
+	po->save = phases_save;
+	po->load = phases_load;
+	po->reset = phases_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_QUEUE, Q);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_SLEEPRQ, S);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_GETRQ, G);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_INSERT, I);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_SPLIT, X);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_BOUNCE, B);
+}
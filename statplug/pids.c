@@ -0,0 +1,256 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <slab.h>
+#include <topk.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_PIDS(name, data) \
+	struct pids_data *name = (struct pids_data *)data
+
+/* request queued by a pid, indexed by sector, and its D */
+struct pid_req {
+	struct inflight_req r;
+	__u64 d;
+};
+
+struct pids_data {
+	GTree *reqs;
+	GPtrArray *done;
+	struct inflight in;
+	struct slab slab;
+
+	/* heaviest pids by bios queued, bytes queued and D2C time */
+	struct topk reqs_k;
+	struct topk bytes_k;
+	struct topk d2c_k;
+};
+
+static void insert_p(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+
+	g_tree_insert(pd->reqs, &r->t.sector, r);
+}
+
+static void evict_p(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+
+	g_tree_remove(pd->reqs, &r->t.sector);
+	slab_free(&pd->slab, r);
+}
+
+static void Q(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+	struct pid_req *pr;
+
+	if (!t->bytes)
+		return;
+
+	topk_add(&pd->reqs_k, t->pid, 1);
+	topk_add(&pd->bytes_k, t->pid, t->bytes);
+
+	if (g_tree_lookup(pd->reqs, &t->sector))
+		return;
+
+	pr = slab_alloc(&pd->slab);
+	inflight_insert(&pd->in, &pr->r, t);
+	insert_p(&pr->r, pd);
+
+	inflight_expire(&pd->in, t, evict_p, pd);
+}
+
+static void D(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+	struct pid_req *pr = g_tree_lookup(pd->reqs, &t->sector);
+
+	if (pr && !pr->d)
+		pr->d = t->time;
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+	__u64 first = BIT_START(t);
+	struct pid_req *pr;
+	guint i;
+
+	if (!t_blks(t))
+		return;
+
+	/* the device time goes to the pid that queued the request; the
+	 * bios merged into it are dropped with it */
+	inflight_covered(pd->reqs, &first, t, pd->done);
+	pr = g_tree_lookup(pd->reqs, &t->sector);
+	if (pr) {
+		if (pr->d && t->time >= pr->d)
+			topk_add(&pd->d2c_k, pr->r.t.pid, t->time - pr->d);
+		/* not covered if only its first part completed */
+		if (t_blks(&pr->r.t) > t_blks(t))
+			g_ptr_array_add(pd->done, pr);
+	}
+
+	for (i = 0; i < pd->done->len; i++) {
+		pr = g_ptr_array_index(pd->done, i);
+
+		g_tree_remove(pd->reqs, &pr->r.t.sector);
+		inflight_del(&pd->in, &pr->r);
+		slab_free(&pd->slab, pr);
+	}
+	g_ptr_array_set_size(pd->done, 0);
+
+	inflight_expire(&pd->in, t, evict_p, pd);
+}
+
+void pids_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_PIDS(pd1, data1);
+	DECL_ASSIGN_PIDS(pd2, data2);
+
+	topk_merge(&pd1->reqs_k, &pd2->reqs_k);
+	topk_merge(&pd1->bytes_k, &pd2->bytes_k);
+	topk_merge(&pd1->d2c_k, &pd2->d2c_k);
+	pd1->in.unmatched += pd2->in.unmatched;
+}
+
+void pids_print_results(const void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+
+	topk_print(&pd->reqs_k, "reqs");
+	topk_print(&pd->bytes_k, "bytes");
+	topk_print(&pd->d2c_k, "D2C");
+}
+
+static void emit_topk(struct emitter *e, const struct topk *k,
+		      const char *name)
+{
+	struct topk_entry top[TOPK_PRINT];
+	const char *comm;
+	char key[64];
+	unsigned i, n;
+
+	n = topk_top(k, top, TOPK_PRINT);
+	for (i = 0; i < TOPK_PRINT; i++) {
+		comm = i < n && top[i].comm[0] ? top[i].comm : NULL;
+		if (i < n && !comm)
+			comm = trace_comm(top[i].pid);
+
+		snprintf(key, sizeof(key), "top%u_%s_pid", i + 1, name);
+		emit_u64(e, key, i < n ? top[i].pid : 0);
+		snprintf(key, sizeof(key), "top%u_%s_comm", i + 1, name);
+		emit_string(e, key, comm ? comm : "");
+		snprintf(key, sizeof(key), "top%u_%s", i + 1, name);
+		emit_u64(e, key, i < n ? top[i].count : 0);
+	}
+}
+
+void pids_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+
+	emit_topk(e, &pd->reqs_k, "reqs");
+	emit_topk(e, &pd->bytes_k, "bytes");
+	emit_topk(e, &pd->d2c_k, "d2c_ns");
+}
+
+void pids_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+	__u32 n = pd->in.q.length;
+	GList *l;
+
+	SER_PUT(f, n);
+	for (l = pd->in.q.head; l; l = l->next) {
+		const struct pid_req *pr = l->data;
+
+		SER_PUT(f, pr->r.t);
+		SER_PUT(f, pr->d);
+	}
+	SER_PUT(f, pd->in.unmatched);
+
+	topk_save(&pd->reqs_k, f);
+	topk_save(&pd->bytes_k, f);
+	topk_save(&pd->d2c_k, f);
+}
+
+void pids_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+	struct blk_io_trace t;
+	struct pid_req *pr;
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		pr = slab_alloc(&pd->slab);
+		inflight_insert(&pd->in, &pr->r, &t);
+		SER_GET(f, pr->d);
+		insert_p(&pr->r, pd);
+	}
+	SER_GET(f, pd->in.unmatched);
+
+	topk_load(&pd->reqs_k, f);
+	topk_load(&pd->bytes_k, f);
+	topk_load(&pd->d2c_k, f);
+}
+
+void pids_reset(void *data)
+{
+	DECL_ASSIGN_PIDS(pd, data);
+
+	topk_init(&pd->reqs_k);
+	topk_init(&pd->bytes_k);
+	topk_init(&pd->d2c_k);
+	pd->in.unmatched = 0;
+}
+
+void pids_init(struct plugin *p, struct plugin_set *__unused,
+	       struct plug_args *pa)
+{
+	struct pids_data *pd = p->data = g_new0(struct pids_data, 1);
+
+	pd->reqs = g_tree_new(comp_int64);
+	pd->done = g_ptr_array_new();
+	inflight_init(&pd->in, pa);
+	slab_init(&pd->slab, sizeof(struct pid_req));
+	pids_reset(pd);
+}
+
+void pids_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_PIDS(pd, p->data);
+
+	/* the requests are freed with the slab */
+	g_tree_destroy(pd->reqs);
+	g_ptr_array_free(pd->done, TRUE);
+	slab_destroy(&pd->slab);
+	g_free(p->data);
+}
+
+void pids_ops_init(struct plugin_ops *po)
+{
+	po->add = pids_add;
+	po->print_results = pids_print_results;
+	po->emit = pids_emit;
+	po->save = pids_save;
+	po->load = pids_load;
+	po->reset = pids_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_QUEUE, Q);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
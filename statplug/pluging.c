@@ -4,6 +4,9 @@
 #include <blktrace_api.h>
 #include <blktrace.h>
 #include <plugins.h>
+#include <serialize.h>
+#include <lhist.h>
+#include <emit.h>
 
 #define DECL_ASSIGN_PLUGING(name, data) \
 	struct pluging_data *name = (struct pluging_data *)data
@@ -13,6 +16,7 @@ struct pluging_data {
 	__u64 max;
 	__u64 total;
 	__u64 nplugs;
+	struct lhist times;
 
 	__u64 plug_time;
 	gboolean plugged;
@@ -40,6 +44,7 @@ static void U(struct blk_io_trace *t, void *data)
 
 		plug->min = MIN(plug->min, time);
 		plug->max = MAX(plug->max, time);
+		lhist_record(&plug->times, time);
 
 		plug->plugged = FALSE;
 		plug->plug_time = 0;
@@ -55,37 +60,95 @@ void pluging_add(void *data1, const void *data2)
 	plug1->max = MAX(plug1->max, plug2->max);
 	plug1->total += plug2->total;
 	plug1->nplugs += plug2->nplugs;
+	lhist_add(&plug1->times, &plug2->times);
 }
 
 void pluging_print_results(const void *data)
 {
 	DECL_ASSIGN_PLUGING(plug, data);
 
-	if (plug->nplugs)
+	if (plug->nplugs) {
 		printf("Plug Time Min: %f Avg: %f Max: %f (sec)\n",
 		       NANO_ULL_TO_DOUBLE(plug->min),
 		       NANO_ULL_TO_DOUBLE(plug->total) / plug->nplugs,
 		       NANO_ULL_TO_DOUBLE(plug->max));
-	else
+		lhist_print(&plug->times, "Plug Time", 1e9, "sec");
+	} else
 		printf("No plugging in this range\n");
 }
 
-void pluging_init(struct plugin *p, struct plugin_set *__un1,
-		  struct plug_args *__un2)
+void pluging_emit(const void *data, struct emitter *e)
 {
-	struct pluging_data *plug = p->data = g_new(struct pluging_data, 1);
+	DECL_ASSIGN_PLUGING(plug, data);
+
+	emit_u64(e, "plugs", plug->nplugs);
+	emit_double(e, "plug_min_sec",
+		    plug->nplugs ? NANO_ULL_TO_DOUBLE(plug->min) : 0);
+	emit_double(e, "plug_avg_sec",
+		    plug->nplugs ? NANO_ULL_TO_DOUBLE(plug->total) /
+					   plug->nplugs :
+				   0);
+	emit_double(e, "plug_max_sec", NANO_ULL_TO_DOUBLE(plug->max));
+	lhist_emit(&plug->times, e, "plug_sec", 1e9);
+}
+
+void pluging_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_PLUGING(plug, data);
+
+	SER_PUT(f, plug->min);
+	SER_PUT(f, plug->max);
+	SER_PUT(f, plug->total);
+	SER_PUT(f, plug->nplugs);
+	SER_PUT(f, plug->plug_time);
+	SER_PUT(f, plug->plugged);
+	lhist_save(&plug->times, f);
+}
+
+void pluging_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_PLUGING(plug, data);
 
+	SER_GET(f, plug->min);
+	SER_GET(f, plug->max);
+	SER_GET(f, plug->total);
+	SER_GET(f, plug->nplugs);
+	SER_GET(f, plug->plug_time);
+	SER_GET(f, plug->plugged);
+	lhist_load(&plug->times, f);
+}
+
+void pluging_reset(void *data)
+{
+	DECL_ASSIGN_PLUGING(plug, data);
+
+	/* an ongoing plug is kept */
 	plug->min = ~0;
 	plug->max = 0;
 	plug->total = 0;
 	plug->nplugs = 0;
+	lhist_reset(&plug->times);
+}
+
+void pluging_init(struct plugin *p, struct plugin_set *__un1,
+		  struct plug_args *__un2)
+{
+	struct pluging_data *plug = p->data = g_new(struct pluging_data, 1);
+
+	lhist_init(&plug->times);
+	pluging_reset(plug);
 	plug->plug_time = 0;
+	plug->plugged = FALSE;
 }
 
 void pluging_ops_init(struct plugin_ops *po)
 {
 	po->add = pluging_add;
 	po->print_results = pluging_print_results;
+	po->emit = pluging_emit;
+	po->save = pluging_save;
+	po->load = pluging_load;
+	po->reset = pluging_reset;
 
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_PLUG, P);
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_UNPLUG_IO, U);
@@ -94,5 +157,8 @@ void pluging_ops_init(struct plugin_ops *po)
 
 void pluging_destroy(struct plugin *p)
 {
+	DECL_ASSIGN_PLUGING(plug, p->data);
+
+	lhist_destroy(&plug->times);
 	g_free(p->data);
 }
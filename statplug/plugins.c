@@ -5,10 +5,21 @@
 #include <list_plugins.h>
 
 #include <utils.h>
+#include <serialize.h>
+#include <emit.h>
 
 /* array of operations and function initializer */
 struct plugin_ops ps_ops[N_PLUGINS];
 
+static int plugs_output = OUT_TEXT;
+
+const char *io_class_name[N_IOC] = {
+	[IOC_READ] = "read",	       [IOC_READ_AHEAD] = "readahead",
+	[IOC_META] = "meta",	       [IOC_WRITE] = "write",
+	[IOC_WRITE_SYNC] = "sync write", [IOC_WRITE_FUA] = "fua write",
+	[IOC_FLUSH] = "flush",
+};
+
 struct plugin_set *plugin_set_create(struct plug_args *pia)
 {
 	int i;
@@ -16,6 +27,7 @@ struct plugin_set *plugin_set_create(struct plug_args *pia)
 	struct plugin_set *tmp = g_new(struct plugin_set, 1);
 	tmp->plugs = g_new(struct plugin, N_PLUGINS);
 	tmp->n = N_PLUGINS;
+	tmp->ioc = IOC_READ;
 
 	/* create and initilize a new set of plugins */
 	for (i = 0; i < N_PLUGINS; ++i) {
@@ -41,12 +53,45 @@ void plugin_set_destroy(struct plugin_set *ps)
 void plugin_set_print(const struct plugin_set *ps, const char *head)
 {
 	int i;
+	struct emitter e;
+
+	if (plugs_output != OUT_TEXT) {
+		emit_begin(&e, plugs_output, head);
+		for (i = 0; i < N_PLUGINS; ++i)
+			ps->plugs[i].ops->emit(ps->plugs[i].data, &e);
+		emit_end(&e);
+		return;
+	}
 
 	printf("%s\t=====================================\n", head);
 	for (i = 0; i < N_PLUGINS; ++i)
 		ps->plugs[i].ops->print_results(ps->plugs[i].data);
 }
 
+void plugin_set_print_row_head(const struct plugin_set *ps, const char *head)
+{
+	int i;
+
+	printf("# %s\tstart", head);
+	for (i = 0; i < N_PLUGINS; ++i)
+		if (ps->plugs[i].ops->row_head)
+			printf(" %s", ps->plugs[i].ops->row_head);
+	printf("\n");
+}
+
+void plugin_set_print_row(struct plugin_set *ps, const char *head,
+			  __u64 start, __u64 end)
+{
+	int i;
+
+	printf("%s\t%.4f", head, NANO_ULL_TO_DOUBLE(start));
+	for (i = 0; i < N_PLUGINS; ++i)
+		if (ps->plugs[i].ops->print_row)
+			ps->plugs[i].ops->print_row(ps->plugs[i].data, start,
+						    end);
+	printf("\n");
+}
+
 void plugin_set_add_trace(struct plugin_set *ps, const struct blk_io_trace *t)
 {
 	int i;
@@ -55,6 +100,7 @@ void plugin_set_add_trace(struct plugin_set *ps, const struct blk_io_trace *t)
 	struct plugin *p;
 
 	act = t->action & 0xffff;
+	ps->ioc = io_class(t);
 	for (i = 0; i < N_PLUGINS; ++i) {
 		p = &ps->plugs[i];
 		event_handler =
@@ -76,6 +122,48 @@ void plugin_set_add(struct plugin_set *ps1, const struct plugin_set *ps2)
 	}
 }
 
+void plugin_set_save(const struct plugin_set *ps, FILE *f)
+{
+	int i;
+	__u32 version = PLUGIN_STATE_VERSION, n = N_PLUGINS;
+	struct plugin *p;
+
+	SER_PUT(f, version);
+	SER_PUT(f, n);
+	for (i = 0; i < N_PLUGINS; ++i) {
+		p = &ps->plugs[i];
+		p->ops->save(p->data, f);
+	}
+}
+
+void plugin_set_load(struct plugin_set *ps, FILE *f)
+{
+	int i;
+	__u32 version, n;
+	struct plugin *p;
+
+	SER_GET(f, version);
+	SER_GET(f, n);
+	if (version != PLUGIN_STATE_VERSION || n != N_PLUGINS)
+		error_exit("State file does not match the plugin set\n");
+
+	for (i = 0; i < N_PLUGINS; ++i) {
+		p = &ps->plugs[i];
+		p->ops->load(p->data, f);
+	}
+}
+
+void plugin_set_reset(struct plugin_set *ps)
+{
+	int i;
+	struct plugin *p;
+
+	for (i = 0; i < N_PLUGINS; ++i) {
+		p = &ps->plugs[i];
+		p->ops->reset(p->data);
+	}
+}
+
 void init_plugs_ops()
 {
 	int i;
@@ -86,6 +174,11 @@ void init_plugs_ops()
 	}
 }
 
+void set_plugs_output(int fmt)
+{
+	plugs_output = fmt;
+}
+
 void destroy_plugs_ops()
 {
 	int i;
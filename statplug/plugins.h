@@ -2,8 +2,14 @@
 #define _PLUGINS_H_
 
 #include <glib.h>
+#include <stdio.h>
 #include <blktrace_api.h>
 
+/* bump when the state saved by any plugin (or its meaning) changes */
+#define PLUGIN_STATE_VERSION 19
+
+struct emitter;
+
 typedef void (*event_func_t)(const struct blk_io_trace *, void *);
 struct plugin_ops {
 	/* hash table with key = int of event,
@@ -13,6 +19,21 @@ struct plugin_ops {
 	/* additional functions */
 	void (*add)(void *data1, const void *data2);
 	void (*print_results)(const void *data);
+
+	/* structured output: the same stats as typed fields (see emit.h) */
+	void (*emit)(const void *data, struct emitter *e);
+
+	/* checkpointing: dump/restore the whole state (including
+	   in-flight requests) and clear the accumulated stats while
+	   keeping the in-flight requests */
+	void (*save)(const void *data, FILE *f);
+	void (*load)(void *data, FILE *f);
+	void (*reset)(void *data);
+
+	/* interval mode (optional): names of the columns and the columns
+	   of the window [start, end) */
+	const char *row_head;
+	void (*print_row)(void *data, __u64 start, __u64 end);
 };
 
 struct plugin {
@@ -27,8 +48,45 @@ struct plugin {
 struct plugin_set {
 	struct plugin *plugs;
 	int n;
+
+	/* class of the event being dispatched */
+	unsigned ioc;
+};
+
+/* classes of I/O, from the category bits of the action (the reader drops
+ * discards, see not_real_event) */
+enum io_class {
+	IOC_READ,
+	IOC_READ_AHEAD,
+	IOC_META,
+	IOC_WRITE,
+	IOC_WRITE_SYNC,
+	IOC_WRITE_FUA,
+	IOC_FLUSH,
+	N_IOC
 };
 
+extern const char *io_class_name[N_IOC];
+
+static inline unsigned io_class(const struct blk_io_trace *t)
+{
+	__u32 tc = t->action >> BLK_TC_SHIFT;
+
+	if ((tc & BLK_TC_FLUSH) && !t->bytes)
+		return IOC_FLUSH;
+	if (tc & BLK_TC_META)
+		return IOC_META;
+	if (!(tc & BLK_TC_WRITE))
+		return tc & BLK_TC_AHEAD ? IOC_READ_AHEAD : IOC_READ;
+	if (tc & BLK_TC_FUA)
+		return IOC_WRITE_FUA;
+	return tc & BLK_TC_SYNC ? IOC_WRITE_SYNC : IOC_WRITE;
+}
+
+/* i2c oio timeline: every change, changes coalesced by timestamp or
+ * min/avg/max per bucket of i2c_oio_res */
+enum { OIO_ALL, OIO_CHANGES, OIO_BUCKETS };
+
 struct plug_args {
 	/* d2c args */
 	char *d2c_det_f;
@@ -37,6 +95,29 @@ struct plug_args {
 	/* i2c args */
 	char *i2c_oio_f;
 	char *i2c_oio_hist_f;
+	int i2c_oio_mode;
+	__u64 i2c_oio_res;
+
+	/* heatmap args */
+	char *heat_f;
+	__u32 heat_bands;
+	__u64 heat_res;
+
+	/* cpus args */
+	char *cpus_f;
+
+	/* lifecycle args */
+	char *lifecycle_f;
+
+	/* cpus of the trace (per-cpu files), 0 if unknown */
+	__u32 ncpus;
+
+	/* detail files in binary */
+	gboolean binary;
+
+	/* in-flight limits of q2c and i2c (0 means no limit) */
+	__u64 max_age;
+	__u32 max_inflight;
 };
 
 struct plug_init_dest_funcs {
@@ -51,11 +132,20 @@ struct plug_init_dest_funcs {
 void init_plugs_ops();
 void destroy_plugs_ops();
 
+/* format of plugin_set_print (OUT_* of emit.h) */
+void set_plugs_output(int fmt);
+
 /* plugin set methods */
 struct plugin_set *plugin_set_create(struct plug_args *pia);
 void plugin_set_destroy(struct plugin_set *ps);
 void plugin_set_print(const struct plugin_set *ps, const char *head);
+void plugin_set_print_row_head(const struct plugin_set *ps, const char *head);
+void plugin_set_print_row(struct plugin_set *ps, const char *head,
+			  __u64 start, __u64 end);
 void plugin_set_add_trace(struct plugin_set *ps, const struct blk_io_trace *t);
 void plugin_set_add(struct plugin_set *ps1, const struct plugin_set *ps2);
+void plugin_set_save(const struct plugin_set *ps, FILE *f);
+void plugin_set_load(struct plugin_set *ps, FILE *f);
+void plugin_set_reset(struct plugin_set *ps);
 
 #endif
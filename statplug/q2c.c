@@ -8,12 +8,19 @@
 #include <plugins.h>
 #include <utils.h>
 #include <list_plugins.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <lhist.h>
+#include <emit.h>
 
 #define DECL_ASSIGN_Q2C(name, data) \
 	struct q2c_data *name = (struct q2c_data *)data
 
 struct q2c_data {
-	GHashTable *qs;
+	/* queued bios sorted by sector (see comp_q) */
+	GTree *qs;
+	GPtrArray *done;
+	struct inflight in;
 
 	/* ongoing active period */
 	__u64 start;
@@ -25,34 +32,31 @@ struct q2c_data {
 	__u64 q2c_time;
 	__u32 maxouts;
 
+	/* Q2C time per bio, in total and per class of I/O */
+	struct lhist lat;
+	struct lhist class_lat[N_IOC];
+	const struct plugin_set *ps;
+
 	/* req size data */
 	__u64 q_reqs;
 	__u64 q_total_size;
 };
 
-struct proc_q_arg {
-	__u64 ts;
-	__u64 te;
-	struct q2c_data *q2c;
-};
-
-static gboolean proc_q(gpointer __unused, gpointer tp, gpointer pqap)
+/* order by sector first so the bios covered by a completion are next
+ * to each other. The rest only tells apart bios in the same sector. */
+static gint comp_q(gconstpointer a, gconstpointer b, gpointer __unused)
 {
-	struct blk_io_trace *t = (struct blk_io_trace *)tp;
-	struct proc_q_arg *pqa = (struct proc_q_arg *)pqap;
-
-	__u64 this_s = BIT_START(t), this_e = BIT_END(t);
-	__u64 this_ts = t->time;
+	const struct blk_io_trace *x = a, *y = b;
 
-	if (pqa->ts <= this_s && this_e <= pqa->te) {
-		if (this_ts < pqa->q2c->start)
-			pqa->q2c->start = this_ts;
-		pqa->q2c->processed++;
-		pqa->q2c->outstanding--;
-		return TRUE;
-	} else {
-		return FALSE;
-	}
+	if (x->sector != y->sector)
+		return x->sector > y->sector ? 1 : -1;
+	if (x->time != y->time)
+		return x->time > y->time ? 1 : -1;
+	if (x->cpu != y->cpu)
+		return x->cpu > y->cpu ? 1 : -1;
+	if (x->sequence != y->sequence)
+		return x->sequence > y->sequence ? 1 : -1;
+	return 0;
 }
 
 static void restart_ongoing(struct q2c_data *q2c)
@@ -63,19 +67,62 @@ static void restart_ongoing(struct q2c_data *q2c)
 	q2c->processed = 0;
 }
 
+static void check_idle(struct q2c_data *q2c)
+{
+	if (q2c->outstanding == 0 && q2c->processed > 0) {
+		q2c->q2c_time += q2c->end - q2c->start;
+		restart_ongoing(q2c);
+	}
+}
+
+static void evict_q(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	DECL_ASSIGN_Q2C(q2c, data);
+
+	g_tree_remove(q2c->qs, &r->t);
+	g_free(r);
+	q2c->outstanding--;
+}
+
+static void insert_q(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_Q2C(q2c, data);
+
+	g_tree_insert(q2c->qs, &r->t, r);
+}
+
 static void C(struct blk_io_trace *t, void *data)
 {
 	DECL_ASSIGN_Q2C(q2c, data);
-	struct proc_q_arg pqa = { BIT_START(t), BIT_END(t), q2c };
+	struct blk_io_trace first = { .sector = BIT_START(t) };
+	guint i;
 
 	if (t->time > q2c->end)
 		q2c->end = t->time;
 
-	g_hash_table_foreach_remove(q2c->qs, proc_q, &pqa);
-	if (q2c->outstanding == 0 && q2c->processed > 0) {
-		q2c->q2c_time += q2c->end - q2c->start;
-		restart_ongoing(q2c);
+	/* the bios covered by the completion */
+	inflight_covered(q2c->qs, &first, t, q2c->done);
+
+	for (i = 0; i < q2c->done->len; i++) {
+		struct inflight_req *q = g_ptr_array_index(q2c->done, i);
+		struct blk_io_trace *qt = &q->t;
+
+		if (qt->time < q2c->start)
+			q2c->start = qt->time;
+		q2c->processed++;
+		q2c->outstanding--;
+		lhist_record(&q2c->lat, t->time - qt->time);
+		lhist_record(&q2c->class_lat[q2c->ps->ioc], t->time - qt->time);
+
+		g_tree_remove(q2c->qs, &q->t);
+		inflight_del(&q2c->in, q);
+		g_free(q);
 	}
+	g_ptr_array_set_size(q2c->done, 0);
+
+	inflight_expire(&q2c->in, t, evict_q, q2c);
+	check_idle(q2c);
 }
 
 static void Q(struct blk_io_trace *t, void *data)
@@ -84,11 +131,18 @@ static void Q(struct blk_io_trace *t, void *data)
 
 	__u64 blks = t_blks(t);
 
-	DECL_DUP(struct blk_io_trace, new_t, t);
-	g_hash_table_insert(q2c->qs, new_t, new_t);
+	/* the same event seen twice */
+	if (g_tree_lookup(q2c->qs, t))
+		return;
+
+	insert_q(inflight_add(&q2c->in, t), q2c);
 	q2c->outstanding++;
 	q2c->q_reqs++;
 	q2c->q_total_size += blks;
+
+	inflight_expire(&q2c->in, t, evict_q, q2c);
+	check_idle(q2c);
+
 	q2c->maxouts = MAX(q2c->maxouts, q2c->outstanding);
 }
 
@@ -96,9 +150,16 @@ void q2c_add(void *data1, const void *data2)
 {
 	DECL_ASSIGN_Q2C(q2c1, data1);
 	DECL_ASSIGN_Q2C(q2c2, data2);
+	unsigned i;
 
 	q2c1->q2c_time += q2c2->q2c_time;
 	q2c1->maxouts = MAX(q2c1->maxouts, q2c2->maxouts);
+	q2c1->q_reqs += q2c2->q_reqs;
+	q2c1->q_total_size += q2c2->q_total_size;
+	q2c1->in.unmatched += q2c2->in.unmatched;
+	lhist_add(&q2c1->lat, &q2c2->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_add(&q2c1->class_lat[i], &q2c2->class_lat[i]);
 }
 
 void q2c_print_results(const void *data)
@@ -121,18 +182,114 @@ void q2c_print_results(const void *data)
 		printf("Avg. Q2C Throughput: %f (MB/sec)\n",
 		       (t_req_mb) / (t_time_msec / 1000));
 		printf("Q2C Max outstanding: %u (reqs)\n", q2c->maxouts);
+		lhist_print(&q2c->lat, "Q2C", 1e6, "msec");
+		lhist_print_classes(q2c->class_lat, "Q2C", 1e6, "msec");
 	} else
 		printf("Not enough data for Q2C stats\n");
+
+	if (q2c->in.unmatched)
+		printf("Q2C unmatched: %llu (reqs)\n", q2c->in.unmatched);
+}
+
+void q2c_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_Q2C(q2c, data);
+	double t_time_msec, t_req_mb;
+	char key[64];
+	unsigned i;
+
+	/* include all the outstanding I/Os stats if any */
+	if (q2c->end > 0)
+		q2c->q2c_time += q2c->end - q2c->start;
+
+	t_time_msec = ((double)q2c->q2c_time) / 1e6;
+	t_req_mb = ((double)q2c->q_total_size) / (1 << 11);
+
+	emit_double(e, "q2c_total_msec", t_time_msec);
+	emit_double(e, "q2c_avg_msec",
+		    q2c->q_reqs ? t_time_msec / q2c->q_reqs : 0);
+	emit_double(e, "q2c_avg_blk_msec",
+		    q2c->q_total_size ? t_time_msec / q2c->q_total_size : 0);
+	emit_double(e, "q2c_mb_sec",
+		    q2c->q2c_time ? t_req_mb / (t_time_msec / 1000) : 0);
+	emit_u64(e, "q2c_max_outstanding", q2c->maxouts);
+	lhist_emit(&q2c->lat, e, "q2c_msec", 1e6);
+
+	for (i = 0; i < N_IOC; i++) {
+		emit_class_key(key, sizeof(key), "q2c_msec", i);
+		lhist_emit(&q2c->class_lat[i], e, key, 1e6);
+	}
+
+	emit_u64(e, "q2c_unmatched", q2c->in.unmatched);
 }
 
-void q2c_init(struct plugin *p, struct plugin_set *__un1,
-	      struct plug_args *__un2)
+void q2c_save(const void *data, FILE *f)
 {
+	DECL_ASSIGN_Q2C(q2c, data);
+	unsigned i;
+
+	ser_put_inflight(f, &q2c->in);
+	SER_PUT(f, q2c->start);
+	SER_PUT(f, q2c->end);
+	SER_PUT(f, q2c->processed);
+	SER_PUT(f, q2c->outstanding);
+	SER_PUT(f, q2c->q2c_time);
+	SER_PUT(f, q2c->maxouts);
+	SER_PUT(f, q2c->q_reqs);
+	SER_PUT(f, q2c->q_total_size);
+	lhist_save(&q2c->lat, f);
+	for (i = 0; i < N_IOC; i++)
+		lhist_save(&q2c->class_lat[i], f);
+}
+
+void q2c_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_Q2C(q2c, data);
+	unsigned i;
+
+	ser_get_inflight(f, &q2c->in, insert_q, q2c);
+	SER_GET(f, q2c->start);
+	SER_GET(f, q2c->end);
+	SER_GET(f, q2c->processed);
+	SER_GET(f, q2c->outstanding);
+	SER_GET(f, q2c->q2c_time);
+	SER_GET(f, q2c->maxouts);
+	SER_GET(f, q2c->q_reqs);
+	SER_GET(f, q2c->q_total_size);
+	lhist_load(&q2c->lat, f);
+	for (i = 0; i < N_IOC; i++)
+		lhist_load(&q2c->class_lat[i], f);
+}
+
+void q2c_reset(void *data)
+{
+	DECL_ASSIGN_Q2C(q2c, data);
+	unsigned i;
+
+	/* the ongoing active period is accounted when it finishes */
+	q2c->q2c_time = 0;
+	q2c->maxouts = q2c->outstanding;
+	q2c->q_reqs = q2c->q_total_size = 0;
+	q2c->in.unmatched = 0;
+	lhist_reset(&q2c->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_reset(&q2c->class_lat[i]);
+}
+
+void q2c_init(struct plugin *p, struct plugin_set *ps, struct plug_args *pa)
+{
+	unsigned i;
 	struct q2c_data *q2c = p->data = g_new(struct q2c_data, 1);
-	q2c->qs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
-					g_free);
+	q2c->qs = g_tree_new_full(comp_q, NULL, NULL, NULL);
+	q2c->done = g_ptr_array_new();
+	inflight_init(&q2c->in, pa);
+	lhist_init(&q2c->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_init(&q2c->class_lat[i]);
+	q2c->ps = ps;
 	restart_ongoing(q2c);
 
+	q2c->outstanding = 0;
 	q2c->q2c_time = q2c->maxouts = 0;
 	q2c->q_reqs = q2c->q_total_size = 0;
 }
@@ -141,6 +298,10 @@ void q2c_ops_init(struct plugin_ops *po)
 {
 	po->add = q2c_add;
 	po->print_results = q2c_print_results;
+	po->emit = q2c_emit;
+	po->save = q2c_save;
+	po->load = q2c_load;
+	po->reset = q2c_reset;
 
 	/* association of event int and function */
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
@@ -150,6 +311,13 @@ void q2c_ops_init(struct plugin_ops *po)
 void q2c_destroy(struct plugin *p)
 {
 	DECL_ASSIGN_Q2C(q2c, p->data);
-	g_hash_table_destroy(q2c->qs);
+	unsigned i;
+
+	g_tree_destroy(q2c->qs);
+	inflight_destroy(&q2c->in);
+	lhist_destroy(&q2c->lat);
+	for (i = 0; i < N_IOC; i++)
+		lhist_destroy(&q2c->class_lat[i]);
+	g_ptr_array_free(q2c->done, TRUE);
 	g_free(p->data);
 }
@@ -0,0 +1,372 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <inflight.h>
+#include <slab.h>
+#include <lhist.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_QD(name, data) \
+	struct qd_data *name = (struct qd_data *)data
+
+/*
+ * Saturation curve: the time with requests in the driver (D to C) is split
+ * by the number of them outstanding, in power of two buckets (1, 2-3, 4-7,
+ * ..), and each bucket gets the requests completed at that depth with
+ * their D2C. The IOPS of a bucket is its completions over its time, and by
+ * Little's law they times the average D2C should give back its average
+ * depth, which is printed next to it to tell how well the curve holds.
+ */
+#define QD_BUCKETS 12
+
+/* buckets reaching at least this fraction of the time count for the knee */
+#define QD_KNEE_TIME 0.01
+#define QD_KNEE_IOPS 0.9
+
+struct qd_bucket {
+	__u64 time;
+	__u64 area;
+	__u64 completes;
+	__u64 blks;
+	struct lhist lat;
+};
+
+struct qd_data {
+	struct qd_bucket b[QD_BUCKETS];
+
+	GTree *reqs;
+	struct inflight in;
+	struct slab slab;
+	__u32 qd;
+	__u64 last;
+};
+
+static unsigned bucket(__u32 qd)
+{
+	unsigned i = 0;
+
+	while (qd >>= 1)
+		i++;
+
+	return MIN(i, QD_BUCKETS - 1);
+}
+
+/* the time since the last event was spent at the current depth */
+static void advance(struct qd_data *qd, __u64 time)
+{
+	struct qd_bucket *b;
+
+	if (time <= qd->last)
+		return;
+
+	if (qd->qd) {
+		b = &qd->b[bucket(qd->qd)];
+		b->time += time - qd->last;
+		b->area += (time - qd->last) * qd->qd;
+	}
+	qd->last = time;
+}
+
+static void insert_r(struct inflight_req *r, void *data)
+{
+	DECL_ASSIGN_QD(qd, data);
+
+	g_tree_insert(qd->reqs, &r->t.sector, r);
+	qd->qd++;
+}
+
+static void remove_r(struct qd_data *qd, struct inflight_req *r)
+{
+	g_tree_remove(qd->reqs, &r->t.sector);
+	slab_free(&qd->slab, r);
+	qd->qd--;
+}
+
+static void evict_r(struct inflight_req *r,
+		    const struct blk_io_trace *__unused, void *data)
+{
+	remove_r(data, r);
+}
+
+static void D(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_QD(qd, data);
+	struct inflight_req *r;
+
+	if (!t_blks(t) || g_tree_lookup(qd->reqs, &t->sector))
+		return;
+
+	advance(qd, t->time);
+
+	r = slab_alloc(&qd->slab);
+	inflight_insert(&qd->in, r, t);
+	insert_r(r, qd);
+
+	inflight_expire(&qd->in, t, evict_r, qd);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_QD(qd, data);
+	struct inflight_req *r = g_tree_lookup(qd->reqs, &t->sector);
+	struct qd_bucket *b;
+
+	if (!t_blks(t) || !r)
+		return;
+
+	advance(qd, t->time);
+
+	/* at the depth it completes from, itself included */
+	b = &qd->b[bucket(qd->qd)];
+	b->completes++;
+	b->blks += t_blks(t);
+	if (t->time >= r->t.time)
+		lhist_record(&b->lat, t->time - r->t.time);
+
+	inflight_del(&qd->in, r);
+	remove_r(qd, r);
+
+	inflight_expire(&qd->in, t, evict_r, qd);
+}
+
+/* requeued to the block layer, it leaves the driver */
+static void R(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_QD(qd, data);
+	struct inflight_req *r = g_tree_lookup(qd->reqs, &t->sector);
+
+	if (!r)
+		return;
+
+	advance(qd, t->time);
+	inflight_del(&qd->in, r);
+	remove_r(qd, r);
+}
+
+void qd_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_QD(qd1, data1);
+	DECL_ASSIGN_QD(qd2, data2);
+	unsigned i;
+
+	for (i = 0; i < QD_BUCKETS; i++) {
+		qd1->b[i].time += qd2->b[i].time;
+		qd1->b[i].area += qd2->b[i].area;
+		qd1->b[i].completes += qd2->b[i].completes;
+		qd1->b[i].blks += qd2->b[i].blks;
+		lhist_add(&qd1->b[i].lat, &qd2->b[i].lat);
+	}
+	qd1->in.unmatched += qd2->in.unmatched;
+}
+
+static double iops(const struct qd_bucket *b)
+{
+	return b->time ? b->completes / ((double)b->time / 1e9) : 0;
+}
+
+static double avg_lat(const struct qd_bucket *b)
+{
+	return b->lat.n ? (double)b->lat.sum / b->lat.n : 0;
+}
+
+/* lowest bucket with QD_KNEE_IOPS of the highest IOPS, -1 without any */
+static int knee(const struct qd_data *qd)
+{
+	__u64 total = 0;
+	double max = 0;
+	unsigned i;
+
+	for (i = 0; i < QD_BUCKETS; i++)
+		total += qd->b[i].time;
+
+	for (i = 0; i < QD_BUCKETS; i++)
+		if (qd->b[i].time >= total * QD_KNEE_TIME)
+			max = MAX(max, iops(&qd->b[i]));
+
+	for (i = 0; max && i < QD_BUCKETS; i++)
+		if (qd->b[i].time >= total * QD_KNEE_TIME &&
+		    iops(&qd->b[i]) >= max * QD_KNEE_IOPS)
+			return i;
+
+	return -1;
+}
+
+static void bucket_name(char *buf, size_t len, unsigned i)
+{
+	if (i == QD_BUCKETS - 1)
+		snprintf(buf, len, "%u+", 1U << i);
+	else if (!i)
+		snprintf(buf, len, "1");
+	else
+		snprintf(buf, len, "%u-%u", 1U << i, (2U << i) - 1);
+}
+
+void qd_print_results(const void *data)
+{
+	DECL_ASSIGN_QD(qd, data);
+	const struct qd_bucket *b;
+	__u64 total = 0;
+	char name[16];
+	unsigned i;
+	int k;
+
+	for (i = 0; i < QD_BUCKETS; i++)
+		total += qd->b[i].time;
+	if (!total)
+		return;
+
+	for (i = 0; i < QD_BUCKETS; i++) {
+		b = &qd->b[i];
+		if (!b->time)
+			continue;
+
+		bucket_name(name, sizeof(name), i);
+		printf("QD %s Time: %.2f%%\n", name, 100.0 * b->time / total);
+		printf("QD %s IOPS: %f\n", name, iops(b));
+		printf("QD %s Throughput: %f (MB/sec)\n", name,
+		       ((double)b->blks / (1 << 11)) / ((double)b->time / 1e9));
+		printf("QD %s Avg. QD: %f\n", name, (double)b->area / b->time);
+		printf("QD %s Little QD: %f\n", name,
+		       iops(b) * avg_lat(b) / 1e9);
+		printf("QD %s Avg. D2C: %f (msec)\n", name, avg_lat(b) / 1e6);
+		printf("QD %s D2C p99: %f (msec)\n", name,
+		       lhist_quantile(&b->lat, 0.99) / 1e6);
+	}
+
+	k = knee(qd);
+	if (k >= 0) {
+		bucket_name(name, sizeof(name), k);
+		printf("QD knee: %s (%.0f%% of max. IOPS)\n", name,
+		       100 * QD_KNEE_IOPS);
+	}
+}
+
+void qd_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_QD(qd, data);
+	const struct qd_bucket *b;
+	char key[64];
+	unsigned i;
+	int k = knee(qd);
+
+	for (i = 0; i < QD_BUCKETS; i++) {
+		b = &qd->b[i];
+		snprintf(key, sizeof(key), "qd_%u_sec", 1U << i);
+		emit_double(e, key, b->time / 1e9);
+		snprintf(key, sizeof(key), "qd_%u_iops", 1U << i);
+		emit_double(e, key, iops(b));
+		snprintf(key, sizeof(key), "qd_%u_d2c_avg_msec", 1U << i);
+		emit_double(e, key, avg_lat(b) / 1e6);
+	}
+	emit_u64(e, "qd_knee", k >= 0 ? 1U << k : 0);
+}
+
+void qd_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_QD(qd, data);
+	__u32 n = qd->in.q.length;
+	unsigned i;
+	GList *l;
+
+	SER_PUT(f, n);
+	for (l = qd->in.q.head; l; l = l->next)
+		ser_write(f, l->data, sizeof(struct blk_io_trace));
+	SER_PUT(f, qd->in.unmatched);
+	SER_PUT(f, qd->last);
+
+	for (i = 0; i < QD_BUCKETS; i++) {
+		SER_PUT(f, qd->b[i].time);
+		SER_PUT(f, qd->b[i].area);
+		SER_PUT(f, qd->b[i].completes);
+		SER_PUT(f, qd->b[i].blks);
+		lhist_save(&qd->b[i].lat, f);
+	}
+}
+
+void qd_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_QD(qd, data);
+	struct blk_io_trace t;
+	struct inflight_req *r;
+	unsigned i;
+	__u32 n;
+
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, t);
+		r = slab_alloc(&qd->slab);
+		inflight_insert(&qd->in, r, &t);
+		insert_r(r, qd);
+	}
+	SER_GET(f, qd->in.unmatched);
+	SER_GET(f, qd->last);
+
+	for (i = 0; i < QD_BUCKETS; i++) {
+		SER_GET(f, qd->b[i].time);
+		SER_GET(f, qd->b[i].area);
+		SER_GET(f, qd->b[i].completes);
+		SER_GET(f, qd->b[i].blks);
+		lhist_load(&qd->b[i].lat, f);
+	}
+}
+
+void qd_reset(void *data)
+{
+	DECL_ASSIGN_QD(qd, data);
+	unsigned i;
+
+	/* the requests in the driver stay, at the same depth */
+	for (i = 0; i < QD_BUCKETS; i++) {
+		qd->b[i].time = qd->b[i].area = 0;
+		qd->b[i].completes = qd->b[i].blks = 0;
+		lhist_reset(&qd->b[i].lat);
+	}
+	qd->in.unmatched = 0;
+}
+
+void qd_init(struct plugin *p, struct plugin_set *__unused,
+	     struct plug_args *pa)
+{
+	struct qd_data *qd = p->data = g_new0(struct qd_data, 1);
+	unsigned i;
+
+	for (i = 0; i < QD_BUCKETS; i++)
+		lhist_init(&qd->b[i].lat);
+	qd->reqs = g_tree_new(comp_int64);
+	inflight_init(&qd->in, pa);
+	slab_init(&qd->slab, sizeof(struct inflight_req));
+}
+
+void qd_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_QD(qd, p->data);
+	unsigned i;
+
+	/* the requests are freed with the slab */
+	g_tree_destroy(qd->reqs);
+	slab_destroy(&qd->slab);
+	for (i = 0; i < QD_BUCKETS; i++)
+		lhist_destroy(&qd->b[i].lat);
+	g_free(p->data);
+}
+
+void qd_ops_init(struct plugin_ops *po)
+{
+	po->add = qd_add;
+	po->print_results = qd_print_results;
+	po->emit = qd_emit;
+	po->save = qd_save;
+	po->load = qd_load;
+	po->reset = qd_reset;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_ISSUE, D);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_REQUEUE, R);
+}
@@ -6,12 +6,15 @@
 #include <blktrace.h>
 #include <plugins.h>
 #include <utils.h>
+#include <serialize.h>
+#include <emit.h>
 
 #include <reqsize.h>
 
 static void C(struct blk_io_trace *t, void *data)
 {
 	DECL_ASSIGN_REQSIZE(rsd, data);
+	unsigned ioc = rsd->ps->ioc;
 
 	__u64 blks = t_blks(t);
 
@@ -23,6 +26,8 @@ static void C(struct blk_io_trace *t, void *data)
 		if (!IS_WRITE(t)) {
 			rsd->reads++;
 		}
+		rsd->class_reqs[ioc]++;
+		rsd->class_size[ioc] += blks;
 	}
 }
 
@@ -30,40 +35,140 @@ void reqsize_add(void *data1, const void *data2)
 {
 	DECL_ASSIGN_REQSIZE(rsd1, data1);
 	DECL_ASSIGN_REQSIZE(rsd2, data2);
+	unsigned i;
 
 	rsd1->min = MIN(rsd1->min, rsd2->min);
 	rsd1->max = MAX(rsd1->max, rsd2->max);
 	rsd1->total_size += rsd2->total_size;
 	rsd1->reqs += rsd2->reqs;
 	rsd1->reads += rsd2->reads;
+	for (i = 0; i < N_IOC; i++) {
+		rsd1->class_reqs[i] += rsd2->class_reqs[i];
+		rsd1->class_size[i] += rsd2->class_size[i];
+	}
 }
 
 void reqsize_print_results(const void *data)
 {
 	DECL_ASSIGN_REQSIZE(rsd, data);
+	unsigned i, used = 0;
 
 	if (rsd->reqs)
 		printf("Reqs. #: %lld Reads: %lld (%.1f%%) Size:(min: %lld avg: %f max: %lld (blks))\n",
 		       rsd->reqs, rsd->reads,
 		       100 * ((double)rsd->reads) / rsd->reqs, rsd->min,
 		       ((double)rsd->total_size) / rsd->reqs, rsd->max);
+
+	for (i = 0; i < N_IOC; i++)
+		used += rsd->class_reqs[i] != 0;
+	if (used < 2)
+		return;
+
+	for (i = 0; i < N_IOC; i++) {
+		if (rsd->class_reqs[i])
+			printf("Reqs. %s #: %llu (%.1f%%) Size:(avg: %f (blks))\n",
+			       io_class_name[i], rsd->class_reqs[i],
+			       100 * ((double)rsd->class_reqs[i]) / rsd->reqs,
+			       ((double)rsd->class_size[i]) /
+				       rsd->class_reqs[i]);
+	}
 }
 
-void reqsize_init(struct plugin *p, struct plugin_set *__un1,
-		  struct plug_args *__un2)
+void reqsize_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_REQSIZE(rsd, data);
+	char key[64];
+	unsigned i;
+
+	emit_u64(e, "reqs", rsd->reqs);
+	emit_u64(e, "reads", rsd->reads);
+	emit_u64(e, "size_min_blks", rsd->reqs ? rsd->min : 0);
+	emit_double(e, "size_avg_blks",
+		    rsd->reqs ? ((double)rsd->total_size) / rsd->reqs : 0);
+	emit_u64(e, "size_max_blks", rsd->max);
+	emit_u64(e, "size_total_blks", rsd->total_size);
+
+	for (i = 0; i < N_IOC; i++) {
+		emit_class_key(key, sizeof(key), "reqs", i);
+		emit_u64(e, key, rsd->class_reqs[i]);
+		emit_class_key(key, sizeof(key), "blks", i);
+		emit_u64(e, key, rsd->class_size[i]);
+	}
+}
+
+void reqsize_print_row(void *data, __u64 start, __u64 end)
 {
-	struct reqsize_data *req = p->data = g_new(struct reqsize_data, 1);
+	DECL_ASSIGN_REQSIZE(rsd, data);
+	double secs = NANO_ULL_TO_DOUBLE(end - start);
+
+	/* a last window with all its events at its start */
+	if (end <= start) {
+		printf(" 0.00 0.00");
+		return;
+	}
+
+	printf(" %.2f %.2f", rsd->reqs / secs,
+	       ((double)rsd->total_size) / (1 << 11) / secs);
+}
+
+void reqsize_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_REQSIZE(rsd, data);
+
+	SER_PUT(f, rsd->min);
+	SER_PUT(f, rsd->max);
+	SER_PUT(f, rsd->total_size);
+	SER_PUT(f, rsd->reqs);
+	SER_PUT(f, rsd->reads);
+	SER_PUT(f, rsd->class_reqs);
+	SER_PUT(f, rsd->class_size);
+}
+
+void reqsize_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_REQSIZE(rsd, data);
+
+	SER_GET(f, rsd->min);
+	SER_GET(f, rsd->max);
+	SER_GET(f, rsd->total_size);
+	SER_GET(f, rsd->reqs);
+	SER_GET(f, rsd->reads);
+	SER_GET(f, rsd->class_reqs);
+	SER_GET(f, rsd->class_size);
+}
+
+void reqsize_reset(void *data)
+{
+	DECL_ASSIGN_REQSIZE(req, data);
+
 	req->min = ~0;
 	req->max = 0;
 	req->total_size = 0;
 	req->reqs = 0;
 	req->reads = 0;
+	memset(req->class_reqs, 0, sizeof(req->class_reqs));
+	memset(req->class_size, 0, sizeof(req->class_size));
+}
+
+void reqsize_init(struct plugin *p, struct plugin_set *ps,
+		  struct plug_args *__un2)
+{
+	struct reqsize_data *rsd = p->data = g_new(struct reqsize_data, 1);
+
+	rsd->ps = ps;
+	reqsize_reset(rsd);
 }
 
 void reqsize_ops_init(struct plugin_ops *po)
 {
 	po->add = reqsize_add;
 	po->print_results = reqsize_print_results;
+	po->emit = reqsize_emit;
+	po->save = reqsize_save;
+	po->load = reqsize_load;
+	po->reset = reqsize_reset;
+	po->row_head = "IOPS MB/s";
+	po->print_row = reqsize_print_row;
 
 	/* association of event int and function */
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
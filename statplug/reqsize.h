@@ -5,9 +5,15 @@
 	struct reqsize_data *name = (struct reqsize_data *)data
 
 struct reqsize_data {
+	const struct plugin_set *ps;
+
 	__u64 min;
 	__u64 max;
 	__u64 total_size;
 	__u64 reqs;
 	__u64 reads;
+
+	/* requests and blocks per class of I/O */
+	__u64 class_reqs[N_IOC];
+	__u64 class_size[N_IOC];
 };
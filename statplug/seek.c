@@ -7,6 +7,9 @@
 #include <plugins.h>
 #include <utils.h>
 #include <list_plugins.h>
+#include <serialize.h>
+#include <lhist.h>
+#include <emit.h>
 
 #include <reqsize.h>
 
@@ -21,6 +24,11 @@ struct seek_data {
 	__u64 min;
 	__u64 total;
 	__u64 seeks;
+	struct lhist dists;
+
+	/* distances per class of I/O of the completion that seeks */
+	struct lhist class_dists[N_IOC];
+	const struct plugin_set *ps;
 };
 
 static void C(struct blk_io_trace *t, void *data)
@@ -38,6 +46,9 @@ static void C(struct blk_io_trace *t, void *data)
 			seek->max = MAX(seek->max, distance);
 			seek->min = MIN(seek->min, distance);
 			seek->seeks++;
+			lhist_record(&seek->dists, distance);
+			lhist_record(&seek->class_dists[seek->ps->ioc],
+				     distance);
 		}
 	}
 
@@ -48,11 +59,15 @@ void seek_add(void *data1, const void *data2)
 {
 	DECL_ASSIGN_SEEK(seek1, data1);
 	DECL_ASSIGN_SEEK(seek2, data2);
+	unsigned i;
 
 	seek1->min = MIN(seek1->min, seek2->min);
-	seek1->max = MAX(seek2->max, seek2->max);
+	seek1->max = MAX(seek1->max, seek2->max);
 	seek1->total += seek2->total;
 	seek1->seeks += seek2->seeks;
+	lhist_add(&seek1->dists, &seek2->dists);
+	for (i = 0; i < N_IOC; i++)
+		lhist_add(&seek1->class_dists[i], &seek2->class_dists[i]);
 }
 
 void seek_print_results(const void *data)
@@ -66,22 +81,104 @@ void seek_print_results(const void *data)
 		printf("Seeks #: %llu min: %llu avg: %f max: %llu (blks)\n",
 		       seek->seeks, seek->min,
 		       ((double)seek->total) / seek->seeks, seek->max);
+		printf("Seeks p50: %llu p90: %llu p99: %llu p99.9: %llu max: %llu (blks)\n",
+		       lhist_quantile(&seek->dists, 0.5),
+		       lhist_quantile(&seek->dists, 0.9),
+		       lhist_quantile(&seek->dists, 0.99),
+		       lhist_quantile(&seek->dists, 0.999), seek->dists.max);
+		lhist_print_classes(seek->class_dists, "Seeks", 1, "blks");
 	}
 }
 
-void seek_init(struct plugin *p, struct plugin_set *ps, struct plug_args *__un)
+void seek_emit(const void *data, struct emitter *e)
 {
-	struct seek_data *seek = p->data = g_new0(struct seek_data, 1);
-	seek->lastpos = UINT64_MAX;
+	DECL_ASSIGN_SEEK(seek, data);
+	__u64 blks = seek->req_dat->total_size;
+	char key[64];
+	unsigned i;
+
+	emit_double(e, "seq_pct",
+		    blks ? (1 - ((double)seek->seeks) / blks) * 100 : 0);
+	emit_u64(e, "seeks", seek->seeks);
+	emit_u64(e, "seek_min_blks", seek->seeks ? seek->min : 0);
+	emit_double(e, "seek_avg_blks",
+		    seek->seeks ? ((double)seek->total) / seek->seeks : 0);
+	emit_u64(e, "seek_max_blks", seek->max);
+	lhist_emit(&seek->dists, e, "seek_blks", 1);
+
+	for (i = 0; i < N_IOC; i++) {
+		emit_class_key(key, sizeof(key), "seek_blks", i);
+		lhist_emit(&seek->class_dists[i], e, key, 1);
+	}
+}
+
+void seek_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_SEEK(seek, data);
+	unsigned i;
+
+	SER_PUT(f, seek->lastpos);
+	SER_PUT(f, seek->max);
+	SER_PUT(f, seek->min);
+	SER_PUT(f, seek->total);
+	SER_PUT(f, seek->seeks);
+	lhist_save(&seek->dists, f);
+	for (i = 0; i < N_IOC; i++)
+		lhist_save(&seek->class_dists[i], f);
+}
+
+void seek_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_SEEK(seek, data);
+	unsigned i;
+
+	SER_GET(f, seek->lastpos);
+	SER_GET(f, seek->max);
+	SER_GET(f, seek->min);
+	SER_GET(f, seek->total);
+	SER_GET(f, seek->seeks);
+	lhist_load(&seek->dists, f);
+	for (i = 0; i < N_IOC; i++)
+		lhist_load(&seek->class_dists[i], f);
+}
+
+void seek_reset(void *data)
+{
+	DECL_ASSIGN_SEEK(seek, data);
+	unsigned i;
+
+	/* the last position is kept to measure the next seek */
 	seek->max = 0;
 	seek->min = ~0;
 	seek->total = 0;
 	seek->seeks = 0;
+	lhist_reset(&seek->dists);
+	for (i = 0; i < N_IOC; i++)
+		lhist_reset(&seek->class_dists[i]);
+}
+
+void seek_init(struct plugin *p, struct plugin_set *ps, struct plug_args *__un)
+{
+	struct seek_data *seek = p->data = g_new0(struct seek_data, 1);
+	unsigned i;
+
+	seek->lastpos = UINT64_MAX;
+	seek->ps = ps;
+	lhist_init(&seek->dists);
+	for (i = 0; i < N_IOC; i++)
+		lhist_init(&seek->class_dists[i]);
+	seek_reset(seek);
 	seek->req_dat = (struct reqsize_data *)ps->plugs[REQ_SIZE_IND].data;
 }
 
 void seek_destroy(struct plugin *p)
 {
+	DECL_ASSIGN_SEEK(seek, p->data);
+	unsigned i;
+
+	lhist_destroy(&seek->dists);
+	for (i = 0; i < N_IOC; i++)
+		lhist_destroy(&seek->class_dists[i]);
 	g_free(p->data);
 }
 
@@ -89,6 +186,10 @@ void seek_ops_init(struct plugin_ops *po)
 {
 	po->add = seek_add;
 	po->print_results = seek_print_results;
+	po->emit = seek_emit;
+	po->save = seek_save;
+	po->load = seek_load;
+	po->reset = seek_reset;
 
 	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
 }
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <utils.h>
+#include <plugins.h>
+#include <inflight.h>
+#include <slab.h>
+#include <lhist.h>
+#include <trace.h>
+#include <stack.h>
+
+/* request of a layer, indexed by sector, and the one it was remapped
+ * from in the layer above */
+struct stack_req {
+	struct inflight_req r;
+	__u64 q;
+	__u64 max_child;
+	gboolean children;
+
+	gboolean has_parent;
+	__u32 parent_dev;
+	__u64 parent_sector;
+};
+
+struct stack_layer {
+	__u32 dev;
+	char *name;
+	struct stack_layer *upper;
+
+	GTree *reqs;
+	struct inflight in;
+
+	struct lhist q2c;
+	struct lhist added;
+};
+
+struct stack {
+	GHashTable *layers;
+	const struct plug_args *pa;
+	struct slab slab;
+	GPtrArray *done;
+};
+
+static struct stack_layer *get_layer(struct stack *st, __u32 dev)
+{
+	struct stack_layer *l = g_hash_table_lookup(st->layers,
+						    GUINT_TO_POINTER(dev));
+
+	if (!l) {
+		l = g_new0(struct stack_layer, 1);
+		l->dev = dev;
+		l->reqs = g_tree_new(comp_int64);
+		inflight_init(&l->in, st->pa);
+		lhist_init(&l->q2c);
+		lhist_init(&l->added);
+		g_hash_table_insert(st->layers, GUINT_TO_POINTER(dev), l);
+	}
+
+	return l;
+}
+
+static void evict_req(struct inflight_req *r,
+		      const struct blk_io_trace *__unused, void *data)
+{
+	struct stack *st = data;
+	struct stack_layer *l = g_hash_table_lookup(
+		st->layers, GUINT_TO_POINTER(r->t.device));
+
+	g_tree_remove(l->reqs, &r->t.sector);
+	slab_free(&st->slab, r);
+}
+
+static struct stack_req *new_req(struct stack *st, struct stack_layer *l,
+				 const struct blk_io_trace *t)
+{
+	struct stack_req *sr = slab_alloc(&st->slab);
+
+	inflight_insert(&l->in, &sr->r, t);
+	sr->q = t->time;
+	g_tree_insert(l->reqs, &sr->r.t.sector, sr);
+
+	return sr;
+}
+
+/* request of @l holding @sector */
+static struct stack_req *covering(struct stack_layer *l, __u64 sector)
+{
+	GTreeNode *n = g_tree_upper_bound(l->reqs, &sector);
+	struct stack_req *sr;
+
+	n = n ? g_tree_node_previous(n) : g_tree_node_last(l->reqs);
+	if (!n)
+		return NULL;
+
+	sr = g_tree_node_value(n);
+	return sector < sr->r.t.sector + t_blks(&sr->r.t) ? sr : NULL;
+}
+
+static void Q(struct stack *st, const struct blk_io_trace *t)
+{
+	struct stack_layer *l = get_layer(st, t->device);
+
+	if (!t_blks(t) || g_tree_lookup(l->reqs, &t->sector))
+		return;
+
+	new_req(st, l, t);
+	inflight_expire(&l->in, t, evict_req, st);
+}
+
+static void A(struct stack *st, const struct blk_io_trace *t)
+{
+	const struct blk_io_trace_remap *rm = trace_remap();
+	struct stack_layer *lower, *upper;
+	struct stack_req *child, *parent;
+	__u32 from;
+
+	/* the pdu has the device remapped from and, depending on the kernel,
+	 * the one remapped to before or after it */
+	from = rm->device != t->device ? rm->device : rm->device_from;
+	if (!t_blks(t) || from == t->device)
+		return;
+
+	lower = get_layer(st, t->device);
+	upper = get_layer(st, from);
+	lower->upper = upper;
+
+	child = g_tree_lookup(lower->reqs, &t->sector);
+	if (!child)
+		child = new_req(st, lower, t);
+
+	parent = covering(upper, rm->sector);
+	if (parent) {
+		parent->children = TRUE;
+		child->has_parent = TRUE;
+		child->parent_dev = from;
+		child->parent_sector = parent->r.t.sector;
+	}
+
+	inflight_expire(&lower->in, t, evict_req, st);
+}
+
+static void complete(struct stack *st, struct stack_layer *l,
+		     struct stack_req *sr, __u64 time)
+{
+	__u64 lat = time > sr->q ? time - sr->q : 0;
+	struct stack_layer *pl;
+	struct stack_req *p;
+
+	lhist_record(&l->q2c, lat);
+	if (!sr->children)
+		lhist_record(&l->added, lat);
+	else
+		lhist_record(&l->added,
+			     lat > sr->max_child ? lat - sr->max_child : 0);
+
+	if (sr->has_parent) {
+		pl = g_hash_table_lookup(st->layers,
+					 GUINT_TO_POINTER(sr->parent_dev));
+		p = pl ? g_tree_lookup(pl->reqs, &sr->parent_sector) : NULL;
+		if (p)
+			p->max_child = MAX(p->max_child, lat);
+	}
+}
+
+static void C(struct stack *st, const struct blk_io_trace *t)
+{
+	struct stack_layer *l = g_hash_table_lookup(st->layers,
+						    GUINT_TO_POINTER(t->device));
+	__u64 first = BIT_START(t);
+	struct stack_req *sr;
+	guint i;
+
+	if (!l || !t_blks(t))
+		return;
+
+	/* the bios merged in the request complete with it */
+	inflight_covered(l->reqs, &first, t, st->done);
+
+	for (i = 0; i < st->done->len; i++) {
+		sr = g_ptr_array_index(st->done, i);
+
+		complete(st, l, sr, t->time);
+		g_tree_remove(l->reqs, &sr->r.t.sector);
+		inflight_del(&l->in, &sr->r);
+		slab_free(&st->slab, sr);
+	}
+	g_ptr_array_set_size(st->done, 0);
+
+	inflight_expire(&l->in, t, evict_req, st);
+}
+
+void stack_add_trace(struct stack *st, const struct blk_io_trace *t)
+{
+	switch (t->action & 0xffff) {
+	case __BLK_TA_QUEUE:
+		Q(st, t);
+		break;
+	case __BLK_TA_REMAP:
+		A(st, t);
+		break;
+	case __BLK_TA_COMPLETE:
+		C(st, t);
+		break;
+	}
+}
+
+static unsigned depth(const struct stack_layer *l)
+{
+	unsigned d = 0;
+
+	/* bounded, in case of a loop of remaps */
+	while (l->upper && d < 64) {
+		l = l->upper;
+		d++;
+	}
+
+	return d;
+}
+
+static int comp_depth(const void *a, const void *b)
+{
+	const struct stack_layer *x = *(const struct stack_layer **)a;
+	const struct stack_layer *y = *(const struct stack_layer **)b;
+	unsigned dx = depth(x), dy = depth(y);
+
+	if (dx != dy)
+		return dx > dy ? 1 : -1;
+	return x->dev > y->dev ? 1 : (x->dev < y->dev ? -1 : 0);
+}
+
+static void add_layer(gpointer __unused, gpointer l, gpointer arr)
+{
+	g_ptr_array_add(arr, l);
+}
+
+void stack_print(const struct stack *st)
+{
+	GPtrArray *arr = g_ptr_array_new();
+	struct stack_layer *l;
+	char name[64];
+	guint i;
+
+	g_hash_table_foreach(st->layers, add_layer, arr);
+	qsort(arr->pdata, arr->len, sizeof(gpointer), comp_depth);
+
+	printf("Stack\t=====================================\n");
+	for (i = 0; i < arr->len; i++) {
+		l = g_ptr_array_index(arr, i);
+		if (!l->q2c.n)
+			continue;
+
+		printf("Layer %s (%u,%u)\n", l->name ? l->name : "?",
+		       MAJOR(l->dev), MINOR(l->dev));
+		printf("Layer %u,%u Reqs. #: %llu\n", MAJOR(l->dev),
+		       MINOR(l->dev), l->q2c.n);
+		printf("Layer %u,%u Avg. Q2C: %f (msec)\n", MAJOR(l->dev),
+		       MINOR(l->dev), (double)l->q2c.sum / l->q2c.n / 1e6);
+		printf("Layer %u,%u Avg. added: %f (msec)\n", MAJOR(l->dev),
+		       MINOR(l->dev), (double)l->added.sum / l->added.n / 1e6);
+		printf("Layer %u,%u Unmatched #: %llu\n", MAJOR(l->dev),
+		       MINOR(l->dev), l->in.unmatched);
+		snprintf(name, sizeof(name), "Layer %u,%u Added",
+			 MAJOR(l->dev), MINOR(l->dev));
+		lhist_print(&l->added, name, 1e6, "msec");
+	}
+
+	g_ptr_array_free(arr, TRUE);
+}
+
+void stack_name(struct stack *st, __u32 dev, const char *name)
+{
+	struct stack_layer *l = get_layer(st, dev);
+
+	if (!l->name && name)
+		l->name = g_strdup(name);
+}
+
+struct stack *stack_create(const struct plug_args *pa)
+{
+	struct stack *st = g_new0(struct stack, 1);
+
+	st->layers = g_hash_table_new(g_direct_hash, g_direct_equal);
+	st->pa = pa;
+	slab_init(&st->slab, sizeof(struct stack_req));
+	st->done = g_ptr_array_new();
+
+	return st;
+}
+
+static void free_layer(gpointer __unused, gpointer data, gpointer __un2)
+{
+	struct stack_layer *l = data;
+
+	/* the requests are freed with the slab */
+	g_tree_destroy(l->reqs);
+	lhist_destroy(&l->q2c);
+	lhist_destroy(&l->added);
+	g_free(l->name);
+	g_free(l);
+}
+
+void stack_destroy(struct stack *st)
+{
+	g_hash_table_foreach(st->layers, free_layer, NULL);
+	g_hash_table_destroy(st->layers);
+	slab_destroy(&st->slab);
+	g_ptr_array_free(st->done, TRUE);
+	g_free(st);
+}
@@ -0,0 +1,32 @@
+#ifndef _STACK_H_
+#define _STACK_H_
+
+#include <glib.h>
+
+#include <blktrace_api.h>
+#include <plugins.h>
+
+/*
+ * Latency added by each layer of a stack of devices (e.g. dm-crypt over
+ * md over nvme), from the events of all of them in a single stream. A
+ * remap (A) links the bio of the lower device to the request of the upper
+ * one it comes from, and each layer adds the Q2C of its requests minus
+ * the longest Q2C of the requests remapped from them.
+ */
+
+struct stack;
+
+struct stack *stack_create(const struct plug_args *pa);
+void stack_destroy(struct stack *st);
+
+/* name of the layer of device @dev in the results (the first given) */
+void stack_name(struct stack *st, __u32 dev, const char *name);
+
+/* @t read with the remap pdu available from trace_remap() */
+void stack_add_trace(struct stack *st, const struct blk_io_trace *t);
+
+/* a line and the percentiles of the added latency per layer, from the
+ * top of the stack */
+void stack_print(const struct stack *st);
+
+#endif
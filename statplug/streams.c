@@ -0,0 +1,248 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <lhist.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_STREAMS(name, data) \
+	struct streams_data *name = (struct streams_data *)data
+
+/*
+ * Sequential streams: a completion starting where one of the last
+ * STREAMS_SLOTS streams ended continues it, otherwise it starts a new
+ * stream in the slot of the least recently used one. A stream with more
+ * than one request is sequential, and it ends when it is replaced or
+ * after STREAMS_IDLE without requests.
+ */
+#define STREAMS_SLOTS 32
+#define STREAMS_IDLE 100000000ULL
+
+struct stream {
+	__u64 next;
+	__u64 time;
+	__u64 lru;
+
+	/* blocks since the last reset and requests of the whole stream */
+	__u64 blks;
+	__u64 reqs;
+};
+
+struct streams_data {
+	struct stream s[STREAMS_SLOTS];
+	__u64 clock;
+
+	__u64 reqs;
+	__u64 seq_reqs;
+	__u64 streams;
+	__u64 conc_sum;
+	__u32 conc_max;
+	struct lhist lens;
+};
+
+static gboolean sequential(const struct stream *s)
+{
+	return s->reqs > 1;
+}
+
+static void end_stream(struct lhist *lens, struct stream *s)
+{
+	if (sequential(s) && s->blks)
+		lhist_record(lens, s->blks);
+	memset(s, 0, sizeof(*s));
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+	__u64 blks = t_blks(t);
+	struct stream *s, *match = NULL, *lru = NULL;
+	unsigned i, active = 0;
+
+	if (!blks)
+		return;
+
+	for (i = 0; i < STREAMS_SLOTS; i++) {
+		s = &sd->s[i];
+		if (s->reqs && t->time > s->time + STREAMS_IDLE)
+			end_stream(&sd->lens, s);
+
+		if (s->reqs && s->next == t->sector)
+			match = s;
+		if (!lru || s->lru < lru->lru)
+			lru = s;
+	}
+
+	if (match) {
+		s = match;
+		if (s->reqs == 1)
+			sd->streams++;
+		sd->seq_reqs++;
+	} else {
+		s = lru;
+		end_stream(&sd->lens, s);
+	}
+
+	s->next = t->sector + blks;
+	s->time = t->time;
+	s->lru = ++sd->clock;
+	s->blks += blks;
+	s->reqs++;
+	sd->reqs++;
+
+	for (i = 0; i < STREAMS_SLOTS; i++)
+		active += sequential(&sd->s[i]);
+	sd->conc_sum += active;
+	sd->conc_max = MAX(sd->conc_max, active);
+}
+
+/* the streams still active end with the range, once printed (before it
+ * is added to the total) */
+static void end_active(struct streams_data *sd)
+{
+	unsigned i;
+
+	for (i = 0; i < STREAMS_SLOTS; i++)
+		if (sd->s[i].reqs)
+			end_stream(&sd->lens, &sd->s[i]);
+}
+
+void streams_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_STREAMS(sd1, data1);
+	DECL_ASSIGN_STREAMS(sd2, data2);
+
+	sd1->reqs += sd2->reqs;
+	sd1->seq_reqs += sd2->seq_reqs;
+	sd1->streams += sd2->streams;
+	sd1->conc_sum += sd2->conc_sum;
+	sd1->conc_max = MAX(sd1->conc_max, sd2->conc_max);
+	lhist_add(&sd1->lens, &sd2->lens);
+}
+
+static double seq_pct(const struct streams_data *sd)
+{
+	return sd->reqs ? 100.0 * sd->seq_reqs / sd->reqs : 0;
+}
+
+static double conc_avg(const struct streams_data *sd)
+{
+	return sd->reqs ? (double)sd->conc_sum / sd->reqs : 0;
+}
+
+void streams_print_results(const void *data)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+	const struct lhist *lens = &sd->lens;
+
+	end_active(sd);
+	if (!sd->reqs)
+		return;
+
+	printf("Streams #: %llu\n", sd->streams);
+	printf("Avg. concurrent streams: %f\n", conc_avg(sd));
+	printf("Max. concurrent streams: %u\n", sd->conc_max);
+	printf("Seq. reqs: %.2f%%\n", seq_pct(sd));
+
+	lhist_print(lens, "Stream length", 1, "blks");
+}
+
+void streams_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+
+	end_active(sd);
+	emit_u64(e, "streams", sd->streams);
+	emit_double(e, "streams_conc_avg", conc_avg(sd));
+	emit_u64(e, "streams_conc_max", sd->conc_max);
+	emit_double(e, "streams_seq_reqs_pct", seq_pct(sd));
+	lhist_emit(&sd->lens, e, "stream_blks", 1);
+}
+
+void streams_print_row(void *data, __u64 __unused, __u64 __un2)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+
+	printf(" %.2f %.2f", conc_avg(sd), seq_pct(sd));
+}
+
+void streams_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+
+	SER_PUT(f, sd->s);
+	SER_PUT(f, sd->clock);
+	SER_PUT(f, sd->reqs);
+	SER_PUT(f, sd->seq_reqs);
+	SER_PUT(f, sd->streams);
+	SER_PUT(f, sd->conc_sum);
+	SER_PUT(f, sd->conc_max);
+	lhist_save(&sd->lens, f);
+}
+
+void streams_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+
+	SER_GET(f, sd->s);
+	SER_GET(f, sd->clock);
+	SER_GET(f, sd->reqs);
+	SER_GET(f, sd->seq_reqs);
+	SER_GET(f, sd->streams);
+	SER_GET(f, sd->conc_sum);
+	SER_GET(f, sd->conc_max);
+	lhist_load(&sd->lens, f);
+}
+
+void streams_reset(void *data)
+{
+	DECL_ASSIGN_STREAMS(sd, data);
+	unsigned i;
+
+	/* the streams go on, with their blocks counted again */
+	for (i = 0; i < STREAMS_SLOTS; i++)
+		sd->s[i].blks = 0;
+
+	sd->reqs = 0;
+	sd->seq_reqs = 0;
+	sd->streams = 0;
+	sd->conc_sum = 0;
+	sd->conc_max = 0;
+	lhist_reset(&sd->lens);
+}
+
+void streams_init(struct plugin *p, struct plugin_set *__unused,
+		  struct plug_args *__un2)
+{
+	struct streams_data *sd = p->data = g_new0(struct streams_data, 1);
+
+	lhist_init(&sd->lens);
+}
+
+void streams_destroy(struct plugin *p)
+{
+	DECL_ASSIGN_STREAMS(sd, p->data);
+
+	lhist_destroy(&sd->lens);
+	g_free(p->data);
+}
+
+void streams_ops_init(struct plugin_ops *po)
+{
+	po->add = streams_add;
+	po->print_results = streams_print_results;
+	po->emit = streams_emit;
+	po->save = streams_save;
+	po->load = streams_load;
+	po->reset = streams_reset;
+	po->row_head = "Streams Seq(%)";
+	po->print_row = streams_print_row;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
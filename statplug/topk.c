@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <utils.h>
+#include <serialize.h>
+#include <trace.h>
+#include <topk.h>
+
+static void swap(struct topk *k, unsigned i, unsigned j)
+{
+	struct topk_entry e = k->e[i];
+	__u32 pid = k->pids[i];
+
+	k->e[i] = k->e[j];
+	k->e[j] = e;
+	k->pids[i] = k->pids[j];
+	k->pids[j] = pid;
+}
+
+static void sift_up(struct topk *k, unsigned i)
+{
+	while (i && k->e[(i - 1) / 2].count > k->e[i].count) {
+		swap(k, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(struct topk *k, unsigned i)
+{
+	unsigned min, l;
+
+	for (;;) {
+		min = i;
+		l = 2 * i + 1;
+		if (l < k->n && k->e[l].count < k->e[min].count)
+			min = l;
+		if (l + 1 < k->n && k->e[l + 1].count < k->e[min].count)
+			min = l + 1;
+		if (min == i)
+			break;
+
+		swap(k, i, min);
+		i = min;
+	}
+}
+
+static void set_pid(struct topk *k, unsigned i, __u32 pid)
+{
+	const char *comm = trace_comm(pid);
+
+	k->pids[i] = k->e[i].pid = pid;
+	g_strlcpy(k->e[i].comm, comm ? comm : "", sizeof(k->e[i].comm));
+}
+
+void topk_init(struct topk *k)
+{
+	k->n = 0;
+	k->total = 0;
+}
+
+void topk_add(struct topk *k, __u32 pid, __u64 w)
+{
+	unsigned i;
+
+	k->total += w;
+
+	for (i = 0; i < k->n; i++) {
+		if (k->pids[i] == pid) {
+			/* the name may come after the first request */
+			if (!k->e[i].comm[0])
+				set_pid(k, i, pid);
+			k->e[i].count += w;
+			sift_down(k, i);
+			return;
+		}
+	}
+
+	if (k->n < TOPK_SLOTS) {
+		i = k->n++;
+		k->e[i].count = w;
+		k->e[i].err = 0;
+		set_pid(k, i, pid);
+		sift_up(k, i);
+		return;
+	}
+
+	/* the lightest pid is replaced */
+	k->e[0].err = k->e[0].count;
+	k->e[0].count += w;
+	set_pid(k, 0, pid);
+	sift_down(k, 0);
+}
+
+static __u64 min_count(const struct topk *k)
+{
+	return k->n == TOPK_SLOTS ? k->e[0].count : 0;
+}
+
+static int comp_count(const void *a, const void *b)
+{
+	const struct topk_entry *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->pid > y->pid ? 1 : (x->pid < y->pid ? -1 : 0);
+}
+
+static const struct topk_entry *find(const struct topk *k, __u32 pid)
+{
+	unsigned i;
+
+	for (i = 0; i < k->n; i++)
+		if (k->pids[i] == pid)
+			return &k->e[i];
+	return NULL;
+}
+
+void topk_merge(struct topk *k1, const struct topk *k2)
+{
+	struct topk_entry all[2 * TOPK_SLOTS];
+	const struct topk_entry *o;
+	__u64 min1 = min_count(k1), min2 = min_count(k2);
+	unsigned i, n = 0;
+
+	/* a pid missing in a full table may have up to its min. count */
+	for (i = 0; i < k1->n; i++) {
+		all[n] = k1->e[i];
+		o = find(k2, k1->pids[i]);
+		all[n].count += o ? o->count : min2;
+		all[n].err += o ? o->err : min2;
+		if (o && !all[n].comm[0])
+			memcpy(all[n].comm, o->comm, sizeof(o->comm));
+		n++;
+	}
+	for (i = 0; i < k2->n; i++) {
+		if (find(k1, k2->pids[i]))
+			continue;
+		all[n] = k2->e[i];
+		all[n].count += min1;
+		all[n].err += min1;
+		n++;
+	}
+
+	qsort(all, n, sizeof(all[0]), comp_count);
+
+	k1->n = MIN(n, TOPK_SLOTS);
+	for (i = 0; i < k1->n; i++) {
+		k1->e[i] = all[i];
+		k1->pids[i] = all[i].pid;
+	}
+	for (i = k1->n / 2; i-- > 0;)
+		sift_down(k1, i);
+
+	k1->total += k2->total;
+}
+
+unsigned topk_top(const struct topk *k, struct topk_entry *out, unsigned n)
+{
+	struct topk_entry all[TOPK_SLOTS];
+
+	memcpy(all, k->e, k->n * sizeof(all[0]));
+	qsort(all, k->n, sizeof(all[0]), comp_count);
+
+	n = MIN(n, k->n);
+	memcpy(out, all, n * sizeof(all[0]));
+
+	return n;
+}
+
+void topk_print(const struct topk *k, const char *name)
+{
+	struct topk_entry top[TOPK_PRINT];
+	const char *comm;
+	unsigned i, n;
+
+	if (!k->total)
+		return;
+
+	n = topk_top(k, top, TOPK_PRINT);
+	printf("Top %s:", name);
+	for (i = 0; i < n; i++) {
+		comm = top[i].comm[0] ? top[i].comm : trace_comm(top[i].pid);
+		printf("%s %u (%s) %.1f%%", i ? "," : "", top[i].pid,
+		       comm ? comm : "?", 100.0 * top[i].count / k->total);
+	}
+	printf("\n");
+}
+
+void topk_save(const struct topk *k, FILE *f)
+{
+	SER_PUT(f, k->n);
+	SER_PUT(f, k->total);
+	ser_write(f, k->e, k->n * sizeof(k->e[0]));
+}
+
+void topk_load(struct topk *k, FILE *f)
+{
+	unsigned i;
+
+	SER_GET(f, k->n);
+	SER_GET(f, k->total);
+	if (k->n > TOPK_SLOTS)
+		error_exit("Truncated or corrupted state file\n");
+
+	ser_read(f, k->e, k->n * sizeof(k->e[0]));
+	for (i = 0; i < k->n; i++)
+		k->pids[i] = k->e[i].pid;
+}
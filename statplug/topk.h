@@ -0,0 +1,50 @@
+#ifndef _TOPK_H_
+#define _TOPK_H_
+
+#include <stdio.h>
+#include <glib.h>
+
+#include <blktrace_api.h>
+#include <trace.h>
+
+/*
+ * Heaviest pids of a weighted stream with the space-saving algorithm: a
+ * fixed number of counters, and a new pid takes the counter of the
+ * lightest one (keeping its count as the possible error). Any pid with
+ * more than total/TOPK_SLOTS is in the table and the count of each one is
+ * at most err over its real value. Two tables merge with the same bounds.
+ */
+
+#define TOPK_SLOTS 64
+#define TOPK_PRINT 5
+
+struct topk_entry {
+	__u64 count;
+	__u64 err;
+	__u32 pid;
+	char comm[TRACE_COMM_LEN + 1];
+};
+
+struct topk {
+	/* min-heap by count; the pids apart so they are found quickly */
+	struct topk_entry e[TOPK_SLOTS];
+	__u32 pids[TOPK_SLOTS];
+	__u32 n;
+
+	__u64 total;
+};
+
+void topk_init(struct topk *k);
+void topk_add(struct topk *k, __u32 pid, __u64 w);
+void topk_merge(struct topk *k1, const struct topk *k2);
+
+/* the heaviest @n entries (at most) in @out, heaviest first */
+unsigned topk_top(const struct topk *k, struct topk_entry *out, unsigned n);
+
+/* "Top <name>: <pid> (<comm>) <share>%, ..." */
+void topk_print(const struct topk *k, const char *name);
+
+void topk_save(const struct topk *k, FILE *f);
+void topk_load(struct topk *k, FILE *f);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <errno.h>
+#include <glib.h>
+
+#include <utils.h>
+#include <writer.h>
+
+/* full buffers of all the files, written by a single thread */
+static GAsyncQueue *jobs;
+static GThread *writer_thread;
+
+static gpointer writer_main(gpointer __unused)
+{
+	struct writer_buf *b;
+
+	while ((b = g_async_queue_pop(jobs))) {
+		if (b->len && !b->w->error &&
+		    fwrite(b->data, b->len, 1, b->w->f) != 1)
+			b->w->error = errno ? errno : EIO;
+
+		b->len = 0;
+		g_async_queue_push(b->w->free_q, b);
+	}
+
+	return NULL;
+}
+
+struct writer *writer_open(const char *filename)
+{
+	int i;
+	struct writer *w;
+	FILE *f = fopen(filename, "w");
+
+	if (!f)
+		return NULL;
+
+	if (!writer_thread) {
+		jobs = g_async_queue_new();
+		writer_thread = g_thread_new("writer", writer_main, NULL);
+	}
+
+	w = g_new(struct writer, 1);
+	w->f = f;
+	w->filename = g_strdup(filename);
+	w->error = 0;
+	w->free_q = g_async_queue_new();
+
+	/* double buffering */
+	for (i = 0; i < 2; i++) {
+		struct writer_buf *b = g_new(struct writer_buf, 1);
+
+		b->w = w;
+		b->data = g_malloc(WRITER_BUF);
+		b->len = 0;
+		g_async_queue_push(w->free_q, b);
+	}
+	w->cur = g_async_queue_pop(w->free_q);
+
+	return w;
+}
+
+static void writer_check(struct writer *w)
+{
+	if (w->error)
+		error_exit("Error writing %s: %s\n", w->filename,
+			   strerror(w->error));
+}
+
+void __writer_flush(struct writer *w)
+{
+	g_async_queue_push(jobs, w->cur);
+	w->cur = g_async_queue_pop(w->free_q);
+
+	writer_check(w);
+}
+
+void writer_write(struct writer *w, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len) {
+		size_t n = MIN(len, WRITER_BUF - w->cur->len);
+
+		memcpy(w->cur->data + w->cur->len, p, n);
+		w->cur->len += n;
+		p += n;
+		len -= n;
+
+		if (w->cur->len == WRITER_BUF)
+			__writer_flush(w);
+	}
+}
+
+void writer_close(struct writer *w)
+{
+	int i;
+
+	/* wait for both buffers to be written */
+	g_async_queue_push(jobs, w->cur);
+	for (i = 0; i < 2; i++) {
+		struct writer_buf *b = g_async_queue_pop(w->free_q);
+
+		g_free(b->data);
+		g_free(b);
+	}
+
+	if (fclose(w->f) && !w->error)
+		w->error = errno;
+	writer_check(w);
+
+	g_async_queue_unref(w->free_q);
+	g_free(w->filename);
+	g_free(w);
+}
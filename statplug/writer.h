@@ -0,0 +1,97 @@
+#ifndef _WRITER_H_
+#define _WRITER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include <blktrace_api.h>
+
+/*
+ * Buffered output for the detail files. The analysis only appends to a
+ * large buffer; full buffers are written by a background thread while
+ * the other buffer of the file is filled, so the analysis only waits if
+ * the disk is slower than the trace.
+ */
+
+#define WRITER_BUF (1 << 20)
+
+struct writer_buf {
+	struct writer *w;
+	char *data;
+	size_t len;
+};
+
+struct writer {
+	FILE *f;
+	char *filename;
+
+	/* buffer being filled and buffers given back by the thread */
+	struct writer_buf *cur;
+	GAsyncQueue *free_q;
+
+	/* errno of the first failed write */
+	int error;
+};
+
+/* NULL (and errno set) if @filename cannot be opened */
+struct writer *writer_open(const char *filename);
+void writer_close(struct writer *w);
+
+void __writer_flush(struct writer *w);
+void writer_write(struct writer *w, const void *buf, size_t len);
+
+/* room for @n (< WRITER_BUF) bytes to be formatted in place and then
+ * committed */
+static inline char *writer_reserve(struct writer *w, size_t n)
+{
+	if (w->cur->len + n > WRITER_BUF)
+		__writer_flush(w);
+	return w->cur->data + w->cur->len;
+}
+
+static inline void writer_commit(struct writer *w, size_t n)
+{
+	w->cur->len += n;
+}
+
+/* formatters without printf, returning the length written in @p */
+static inline size_t fmt_u64(char *p, __u64 v)
+{
+	char tmp[20];
+	size_t n = 0, i;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	for (i = 0; i < n; i++)
+		p[i] = tmp[n - i - 1];
+
+	return n;
+}
+
+/* same as "%f" of the time in seconds */
+static inline size_t fmt_sec(char *p, __u64 ns)
+{
+	__u64 us = ns / 1000;
+	size_t n;
+	int i;
+
+	/* ties depend on how the double is rounded, let printf decide */
+	if (ns % 1000 == 500)
+		return sprintf(p, "%f", ns / 1e9);
+	if (ns % 1000 > 500)
+		us++;
+
+	n = fmt_u64(p, us / 1000000);
+	p[n++] = '.';
+	us %= 1000000;
+	for (i = 5; i >= 0; i--, us /= 10)
+		p[n + i] = '0' + us % 10;
+
+	return n + 6;
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include <asm/types.h>
+#include <glib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <blktrace_api.h>
+#include <blktrace.h>
+#include <plugins.h>
+#include <utils.h>
+#include <serialize.h>
+#include <emit.h>
+
+#define DECL_ASSIGN_WSS(name, data) \
+	struct wss_data *name = (struct wss_data *)data
+
+/*
+ * Distinct 4KiB blocks (of each device) completed, counted with a
+ * HyperLogLog sketch of 2^WSS_P registers (about 0.8% of error). Two
+ * sketches merge exactly with the max. of each register, which is also
+ * how the working set of reads and writes together is found.
+ */
+#define WSS_P 14
+#define WSS_REGS (1 << WSS_P)
+#define WSS_BLK_SHIFT 3
+
+enum { WSS_READ, WSS_WRITE, N_WSS };
+
+struct wss_data {
+	__u8 regs[N_WSS][WSS_REGS];
+};
+
+static void hll_add(__u8 *regs, __u64 h)
+{
+	unsigned i = h >> (64 - WSS_P);
+	__u64 w = h << WSS_P;
+	__u8 rank = w ? __builtin_clzll(w) + 1 : 64 - WSS_P + 1;
+
+	if (regs[i] < rank)
+		regs[i] = rank;
+}
+
+static __u64 hll_count(const __u8 *r1, const __u8 *r2)
+{
+	double m = WSS_REGS, sum = 0, e;
+	unsigned i, zeros = 0;
+	__u8 r;
+
+	for (i = 0; i < WSS_REGS; i++) {
+		r = r2 ? MAX(r1[i], r2[i]) : r1[i];
+		sum += ldexp(1.0, -r);
+		zeros += !r;
+	}
+
+	e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+	/* linear counting for the small sets */
+	if (e <= 2.5 * m && zeros)
+		e = m * log(m / zeros);
+
+	return (__u64)(e + 0.5);
+}
+
+static void C(struct blk_io_trace *t, void *data)
+{
+	DECL_ASSIGN_WSS(wss, data);
+	__u64 blks = t_blks(t), dev, b, last;
+	__u8 *regs;
+
+	if (!blks)
+		return;
+
+	regs = wss->regs[IS_WRITE(t) ? WSS_WRITE : WSS_READ];
+	dev = mix(t->device);
+	last = (t->sector + blks - 1) >> WSS_BLK_SHIFT;
+	for (b = t->sector >> WSS_BLK_SHIFT; b <= last; b++)
+		hll_add(regs, mix(b ^ dev));
+}
+
+void wss_add(void *data1, const void *data2)
+{
+	DECL_ASSIGN_WSS(wss1, data1);
+	DECL_ASSIGN_WSS(wss2, data2);
+	unsigned i, j;
+
+	for (i = 0; i < N_WSS; i++)
+		for (j = 0; j < WSS_REGS; j++)
+			wss1->regs[i][j] = MAX(wss1->regs[i][j],
+					       wss2->regs[i][j]);
+}
+
+static double blks_mb(__u64 blks)
+{
+	return (double)blks * (1 << (WSS_BLK_SHIFT + 9)) / (1 << 20);
+}
+
+void wss_print_results(const void *data)
+{
+	DECL_ASSIGN_WSS(wss, data);
+	__u64 all = hll_count(wss->regs[WSS_READ], wss->regs[WSS_WRITE]);
+
+	if (!all)
+		return;
+
+	printf("Working set: %llu (4KiB blks)\n", all);
+	printf("Working set: %f (MB)\n", blks_mb(all));
+	printf("Working set read: %llu (4KiB blks)\n",
+	       hll_count(wss->regs[WSS_READ], NULL));
+	printf("Working set written: %llu (4KiB blks)\n",
+	       hll_count(wss->regs[WSS_WRITE], NULL));
+}
+
+void wss_emit(const void *data, struct emitter *e)
+{
+	DECL_ASSIGN_WSS(wss, data);
+
+	emit_u64(e, "wss_4k_blks",
+		 hll_count(wss->regs[WSS_READ], wss->regs[WSS_WRITE]));
+	emit_u64(e, "wss_read_4k_blks", hll_count(wss->regs[WSS_READ], NULL));
+	emit_u64(e, "wss_write_4k_blks",
+		 hll_count(wss->regs[WSS_WRITE], NULL));
+}
+
+void wss_print_row(void *data, __u64 __unused, __u64 __un2)
+{
+	DECL_ASSIGN_WSS(wss, data);
+
+	printf(" %.2f", blks_mb(hll_count(wss->regs[WSS_READ],
+					  wss->regs[WSS_WRITE])));
+}
+
+void wss_save(const void *data, FILE *f)
+{
+	DECL_ASSIGN_WSS(wss, data);
+
+	SER_PUT(f, wss->regs);
+}
+
+void wss_load(void *data, FILE *f)
+{
+	DECL_ASSIGN_WSS(wss, data);
+
+	SER_GET(f, wss->regs);
+}
+
+void wss_reset(void *data)
+{
+	DECL_ASSIGN_WSS(wss, data);
+
+	memset(wss->regs, 0, sizeof(wss->regs));
+}
+
+void wss_init(struct plugin *p, struct plugin_set *__unused,
+	      struct plug_args *__un2)
+{
+	p->data = g_new0(struct wss_data, 1);
+}
+
+void wss_destroy(struct plugin *p)
+{
+	g_free(p->data);
+}
+
+void wss_ops_init(struct plugin_ops *po)
+{
+	po->add = wss_add;
+	po->print_results = wss_print_results;
+	po->emit = wss_emit;
+	po->save = wss_save;
+	po->load = wss_load;
+	po->reset = wss_reset;
+	po->row_head = "WSS(MB)";
+	po->print_row = wss_print_row;
+
+	/* association of event int and function */
+	g_tree_insert(po->event_tree, (gpointer)__BLK_TA_COMPLETE, C);
+}
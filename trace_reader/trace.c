@@ -4,6 +4,7 @@
 #include <utils.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
 #include <libgen.h>
 
 #include <asm/types.h>
@@ -16,6 +17,7 @@
 
 #include <blktrace.h>
 #include <blktrace_api.h>
+#include <serialize.h>
 
 #define CORRECT_ENDIAN(v)                                      \
 	do {                                                   \
@@ -29,6 +31,24 @@
 
 static int native_trace = -1;
 
+/* command names of the pids seen last in the process notify events. A
+ * pid takes the slot of its hash, replacing the one there, so the memory
+ * is bounded however many pids the trace has */
+#define COMM_SLOTS 4096
+
+struct comm_slot {
+	__u32 pid;
+	char comm[TRACE_COMM_LEN + 1];
+};
+
+static struct comm_slot *comms;
+
+/* pdu of the last remap returned */
+static struct blk_io_trace_remap last_remap;
+
+/* trace of the last event returned */
+static const char *last_dev;
+
 void min_time(gpointer data, gpointer min)
 {
 	struct trace_file *tf = (struct trace_file *)data;
@@ -50,6 +70,7 @@ void correct_time(gpointer data, gpointer dt_arg)
 	struct trace *dt = (struct trace *)dt_arg;
 
 	tf->t.time -= dt->genesis;
+	tf->last -= dt->genesis;
 }
 
 gboolean not_real_event(struct blk_io_trace *t)
@@ -59,17 +80,101 @@ gboolean not_real_event(struct blk_io_trace *t)
 	       (t->action & BLK_TC_ACT(BLK_TC_DRV_DATA));
 }
 
+static struct comm_slot *comm_slot(__u32 pid)
+{
+	return &comms[(pid * 2654435761U) % COMM_SLOTS];
+}
+
+const char *trace_comm(__u32 pid)
+{
+	struct comm_slot *s;
+
+	if (!comms)
+		return NULL;
+
+	s = comm_slot(pid);
+	return s->comm[0] && s->pid == pid ? s->comm : NULL;
+}
+
+const struct blk_io_trace_remap *trace_remap(void)
+{
+	return &last_remap;
+}
+
+const char *trace_dev(void)
+{
+	return last_dev;
+}
+
+static gboolean is_remap(const struct blk_io_trace *t)
+{
+	return (t->action & 0xffff) == __BLK_TA_REMAP &&
+	       t->pdu_len >= sizeof(struct blk_io_trace_remap);
+}
+
+/* the pdu of remaps is always big endian */
+static void read_remap(struct trace_file *tf)
+{
+	struct blk_io_trace_remap *r = &tf->remap;
+
+	if (read(tf->fd, r, sizeof(*r)) != sizeof(*r))
+		memset(r, 0, sizeof(*r));
+	r->device = be32_to_cpu(r->device);
+	r->device_from = be32_to_cpu(r->device_from);
+	r->sector = be64_to_cpu(r->sector);
+
+	if (lseek(tf->fd, tf->pos + sizeof(struct blk_io_trace) + tf->t.pdu_len,
+		  SEEK_SET) == -1)
+		perror_exit("Skipping pdu");
+}
+
+static gboolean is_process_notify(const struct blk_io_trace *t)
+{
+	return (t->action & BLK_TC_ACT(BLK_TC_NOTIFY)) &&
+	       (t->action & 0xffff) == __BLK_TN_PROCESS;
+}
+
+/* keep the command name in the pdu and skip the rest */
+static void read_comm(struct trace_file *tf)
+{
+	char comm[TRACE_COMM_LEN + 1];
+	__u32 n = MIN(tf->t.pdu_len, TRACE_COMM_LEN);
+	struct comm_slot *s;
+
+	if (!comms)
+		comms = g_new0(struct comm_slot, COMM_SLOTS);
+
+	if (read(tf->fd, comm, n) == (ssize_t)n) {
+		comm[n] = '\0';
+		s = comm_slot(tf->t.pid);
+		s->pid = tf->t.pid;
+		memcpy(s->comm, comm, sizeof(s->comm));
+	}
+
+	if (lseek(tf->fd, tf->pos + sizeof(struct blk_io_trace) + tf->t.pdu_len,
+		  SEEK_SET) == -1)
+		perror_exit("Skipping pdu");
+}
+
 void read_next(struct trace_file *tf, __u64 genesis)
 {
 	int e;
 
 	do {
+		tf->pos = tf->next;
 		e = read(tf->fd, &tf->t, sizeof(struct blk_io_trace));
 		if (e == 0) {
 			tf->eof = TRUE;
 			break;
-		} else if (e == -1 || e != sizeof(struct blk_io_trace)) {
+		} else if (e == -1) {
 			perror_exit("Reading trace\n");
+		} else if (e != sizeof(struct blk_io_trace)) {
+			/* partial event at the tail of a trace still being
+			 * written: leave it for a later run */
+			if (lseek(tf->fd, tf->pos, SEEK_SET) == -1)
+				perror_exit("Rewinding trace");
+			tf->eof = TRUE;
+			break;
 		} else {
 			/* verify trace and check endianess */
 			if (native_trace < 0)
@@ -96,25 +201,53 @@ void read_next(struct trace_file *tf, __u64 genesis)
 
 			/* updating to relative time right away */
 			tf->t.time -= genesis;
-
-			if (tf->t.pdu_len) {
+			tf->last = tf->t.time;
+			tf->fresh = TRUE;
+
+			if (tf->t.pdu_len && is_process_notify(&tf->t)) {
+				read_comm(tf);
+			} else if (is_remap(&tf->t)) {
+				read_remap(tf);
+			} else if (tf->t.pdu_len) {
 				e = lseek(tf->fd, tf->t.pdu_len, SEEK_CUR);
 				if (e == -1)
 					perror_exit("Skipping pdu");
 			}
+
+			tf->next = tf->pos + sizeof(struct blk_io_trace) +
+				   tf->t.pdu_len;
 		}
 	} while (not_real_event(&tf->t));
 }
 
-void find_input_traces(struct trace *trace, const char *dev)
+static struct trace_file *open_trace_file(const char *path, off_t pos)
+{
+	struct trace_file *tf = g_new(struct trace_file, 1);
+
+	tf->path = g_strdup(path);
+	tf->fd = open(path, O_RDONLY);
+	if (tf->fd < 0)
+		perror_exit("Opening tracefile");
+
+	if (pos && lseek(tf->fd, pos, SEEK_SET) == -1)
+		perror_exit("Seeking tracefile");
+
+	tf->eof = FALSE;
+	tf->pos = tf->next = pos;
+	tf->last = 0;
+	tf->fresh = FALSE;
+	tf->dev = NULL;
+
+	return tf;
+}
+
+/* call @func with the path of each per-cpu file of @dev */
+void foreach_trace_file(const char *dev, GFunc func, gpointer data)
 {
 	struct dirent *d;
 	char pre_trace[FILENAME_MAX];
 	char file_path[FILENAME_MAX];
 
-	struct trace_file *tf;
-	struct trace_file *min = NULL;
-
 	char *basen, *dirn;
 	char *basec = strdup(dev);
 	char *dirc = strdup(dev);
@@ -129,38 +262,126 @@ void find_input_traces(struct trace *trace, const char *dev)
 	sprintf(pre_trace, "%s.blktrace.", basen);
 	while ((d = readdir(cur_dir))) {
 		if (strstr(d->d_name, pre_trace) == d->d_name) {
-			tf = g_new(struct trace_file, 1);
-			trace->files = g_slist_prepend(trace->files, tf);
-
 			sprintf(file_path, "%s/%s", dirn, d->d_name);
+			func(file_path, data);
+		}
+	}
 
-			tf->fd = open(file_path, O_RDONLY);
-			if (tf->fd < 0)
-				perror_exit("Opening tracefile");
+	closedir(cur_dir);
+	free(basec);
+	free(dirc);
+}
 
-			tf->eof = FALSE;
+void add_input_trace(gpointer path, gpointer trace_arg)
+{
+	struct trace *trace = (struct trace *)trace_arg;
+	struct trace_file *tf = open_trace_file(path, 0);
 
-			read_next(tf, 0);
-		}
-	}
+	trace->files = g_slist_prepend(trace->files, tf);
+	read_next(tf, 0);
+}
 
-	if (g_slist_length(trace->files) == 0)
-		error_exit("No such traces: %s\n", dev);
+void find_input_traces(struct trace *trace, char **devs, unsigned n)
+{
+	struct trace_file *min = NULL;
+	unsigned i, files = 0;
+	GSList *l;
+
+	for (i = 0; i < n; ++i) {
+		foreach_trace_file(devs[i], add_input_trace, trace);
+
+		if (g_slist_length(trace->files) == files)
+			error_exit("No such traces: %s\n", devs[i]);
+		files = g_slist_length(trace->files);
+
+		/* the files of this trace were prepended */
+		for (l = trace->files; l && !((struct trace_file *)l->data)->dev;
+		     l = l->next)
+			((struct trace_file *)l->data)->dev = devs[i];
+	}
 
 	g_slist_foreach(trace->files, min_time, &min);
 	trace->genesis = min->t.time;
 	g_slist_foreach(trace->files, correct_time, trace);
+}
 
-	closedir(cur_dir);
-	free(basec);
-	free(dirc);
+void add_path(gpointer path, gpointer paths)
+{
+	g_ptr_array_add(paths, g_strdup(path));
+}
+
+int comp_path(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+void max_cpu(gpointer path, gpointer ncpus)
+{
+	const char *suffix = strrchr(path, '.');
+	unsigned *n = ncpus;
+	char *end;
+	unsigned long cpu;
+
+	if (!suffix)
+		return;
+
+	cpu = strtoul(suffix + 1, &end, 10);
+	if (*end == '\0' && end != suffix + 1)
+		*n = MAX(*n, cpu + 1);
+}
+
+unsigned trace_ncpus(const char *dev)
+{
+	unsigned n = 0;
+
+	foreach_trace_file(dev, max_cpu, &n);
+
+	return n;
+}
+
+void trace_identity(const char *dev, GChecksum *sum)
+{
+	unsigned i;
+	char id[FILENAME_MAX + 128];
+	struct stat st;
+	GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+
+	foreach_trace_file(dev, add_path, paths);
+	if (paths->len == 0)
+		error_exit("No such traces: %s\n", dev);
+
+	/* sorted to get the same identity regardless of the dir order */
+	g_ptr_array_sort(paths, comp_path);
+	for (i = 0; i < paths->len; ++i) {
+		char *path = g_ptr_array_index(paths, i);
+
+		if (stat(path, &st) == -1)
+			perror_exit("Checking tracefile");
+
+		sprintf(id, "%s:%llu:%llu:%lld.%09ld;", path,
+			(unsigned long long)st.st_ino,
+			(unsigned long long)st.st_size,
+			(long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+		g_checksum_update(sum, (guchar *)id, strlen(id));
+	}
+
+	g_ptr_array_free(paths, TRUE);
 }
 
 struct trace *trace_create(const char *dev)
 {
 	struct trace *dt = g_new(struct trace, 1);
 	dt->files = NULL;
-	find_input_traces(dt, dev);
+	find_input_traces(dt, (char **)&dev, 1);
+
+	return dt;
+}
+
+struct trace *trace_create_stack(char **devs, unsigned n)
+{
+	struct trace *dt = g_new(struct trace, 1);
+	dt->files = NULL;
+	find_input_traces(dt, devs, n);
 
 	return dt;
 }
@@ -169,6 +390,7 @@ void free_data(gpointer data, gpointer __unused)
 {
 	struct trace_file *tf = (struct trace_file *)data;
 	close(tf->fd);
+	g_free(tf->path);
 	g_free(tf);
 }
 
@@ -177,6 +399,82 @@ void trace_destroy(struct trace *dt)
 	g_slist_foreach(dt->files, free_data, NULL);
 	g_slist_free(dt->files);
 	g_free(dt);
+
+	g_free(comms);
+	comms = NULL;
+}
+
+void save_file(gpointer data, gpointer f)
+{
+	struct trace_file *tf = (struct trace_file *)data;
+	__u32 len = strlen(tf->path);
+
+	SER_PUT(f, len);
+	ser_write(f, tf->path, len);
+	SER_PUT(f, tf->pos);
+}
+
+void trace_save(const struct trace *dt, FILE *f)
+{
+	__u32 n = g_slist_length(dt->files);
+
+	SER_PUT(f, dt->genesis);
+	SER_PUT(f, n);
+	g_slist_foreach(dt->files, save_file, f);
+}
+
+struct trace *trace_restore(FILE *f)
+{
+	__u32 n, len;
+	off_t pos;
+	struct stat st;
+	char path[FILENAME_MAX];
+	struct trace_file *tf;
+	struct trace *dt = g_new(struct trace, 1);
+
+	dt->files = NULL;
+	SER_GET(f, dt->genesis);
+	SER_GET(f, n);
+	while (n--) {
+		SER_GET(f, len);
+		if (len >= FILENAME_MAX)
+			error_exit("Corrupted state file\n");
+		ser_read(f, path, len);
+		path[len] = '\0';
+		SER_GET(f, pos);
+
+		tf = open_trace_file(path, pos);
+		if (fstat(tf->fd, &st) == -1)
+			perror_exit("Checking tracefile");
+		if (st.st_size < pos)
+			error_exit("Trace %s shrank since it was saved\n",
+				   path);
+
+		/* keep the order of the files to break ties as before */
+		dt->files = g_slist_append(dt->files, tf);
+		read_next(tf, dt->genesis);
+	}
+
+	return dt;
+}
+
+void min_horizon(gpointer data, gpointer min)
+{
+	struct trace_file *tf = (struct trace_file *)data;
+	__u64 *horizon = (__u64 *)min;
+
+	/* files without new events are considered idle */
+	if (tf->eof && tf->fresh)
+		*horizon = MIN(*horizon, tf->last);
+}
+
+__u64 trace_horizon(const struct trace *dt)
+{
+	__u64 horizon = G_MAXUINT64;
+
+	g_slist_foreach(dt->files, min_horizon, &horizon);
+
+	return horizon;
 }
 
 gboolean trace_read_next(const struct trace *dt, struct blk_io_trace *t)
@@ -189,6 +487,9 @@ gboolean trace_read_next(const struct trace *dt, struct blk_io_trace *t)
 		return FALSE;
 	else {
 		*t = min->t;
+		if (is_remap(t))
+			last_remap = min->remap;
+		last_dev = min->dev;
 		read_next(min, dt->genesis);
 		return TRUE;
 	}
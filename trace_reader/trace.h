@@ -3,11 +3,28 @@
 
 #include <blktrace_api.h>
 #include <glib.h>
+#include <stdio.h>
+#include <sys/types.h>
 
 struct trace_file {
 	struct blk_io_trace t;
+	struct blk_io_trace_remap remap;
 	int fd;
 	gboolean eof;
+
+	/* offset of the event in @t (or of the end of file if @eof)
+	 * and of the next event to read */
+	off_t pos;
+	off_t next;
+	char *path;
+
+	/* trace (as given) the file is part of, NULL if restored */
+	const char *dev;
+
+	/* time of the last event read and whether any was read since
+	 * the file was opened */
+	__u64 last;
+	gboolean fresh;
 };
 
 struct trace {
@@ -19,8 +36,39 @@ typedef gboolean (*trace_reader_t)(const struct trace *, struct blk_io_trace *);
 
 /* constructor and destructor */
 struct trace *trace_create(const char *dev);
+
+/* the events of all @devs in a single stream, with the same genesis */
+struct trace *trace_create_stack(char **devs, unsigned n);
+
 void trace_destroy(struct trace *dt);
 
+/* save the position of the reader and restore it (possibly with the
+ * files grown since then) */
+void trace_save(const struct trace *dt, FILE *f);
+struct trace *trace_restore(FILE *f);
+
+/* number of cpus of @dev, from the suffix of its per-cpu files */
+unsigned trace_ncpus(const char *dev);
+
+/* feed the identity (name, inode, size and mtime) of the files of
+ * @dev in @sum */
+void trace_identity(const char *dev, GChecksum *sum);
+
+/* time up to which all the files that got new events are complete */
+__u64 trace_horizon(const struct trace *dt);
+
+/* command name of @pid from the process notify events read so far (NULL
+ * if unknown or replaced by a later pid), until the trace is destroyed */
+#define TRACE_COMM_LEN 16
+const char *trace_comm(__u32 pid);
+
+/* pdu of the last remap event returned by the reader, in cpu order */
+const struct blk_io_trace_remap *trace_remap(void);
+
+/* trace of the last event returned by the reader (of the ones given to
+ * trace_create_stack), until they are freed */
+const char *trace_dev(void);
+
 /* default trace reader */
 gboolean trace_read_next(const struct trace *dt, struct blk_io_trace *t);
 